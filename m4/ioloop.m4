@@ -1,7 +1,32 @@
 dnl * I/O loop function
 AC_DEFUN([DOVECOT_IOLOOP], [
   have_ioloop=no
-  
+
+  AS_IF([test "$ioloop" = "io_uring"], [
+    AC_CACHE_CHECK([whether we can use io_uring],i_cv_io_uring_works,[
+      AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[
+        #include <sys/epoll.h>
+        #include <sys/syscall.h>
+        #include <linux/io_uring.h>
+      ]], [[
+        struct io_uring_getevents_arg arg;
+        (void)arg;
+        return __NR_io_uring_setup + __NR_io_uring_enter +
+          IORING_FEAT_EXT_ARG + EPOLL_CTL_ADD;
+      ]])],[
+        i_cv_io_uring_works=yes
+      ], [
+        i_cv_io_uring_works=no
+      ])
+    ])
+    AS_IF([test $i_cv_io_uring_works = yes], [
+      AC_DEFINE(IOLOOP_URING,, [Implement I/O loop with Linux io_uring (falling back to epoll)])
+      have_ioloop=yes
+    ], [
+      AC_MSG_ERROR([io_uring ioloop requested but <linux/io_uring.h> is missing or too old])
+    ])
+  ])
+
   AS_IF([test "$ioloop" = "best" || test "$ioloop" = "epoll"], [
     AC_CACHE_CHECK([whether we can use epoll],i_cv_epoll_works,[
       AC_RUN_IFELSE([AC_LANG_PROGRAM([[
@@ -584,6 +584,11 @@ static void dump_cache(struct mail_cache_view *cache_view, unsigned int seq)
 
 		str_truncate(str, 0);
 		str_printfa(str, "    - %s: ", field->name);
+		if (iter_field.compressed) {
+			str_printfa(str, "(compressed %u bytes)", size);
+			printf("%s\n", str_c(str));
+			continue;
+		}
 		switch (field->type) {
 		case MAIL_CACHE_FIELD_FIXED_SIZE:
 			if (size == sizeof(uint32_t)) {
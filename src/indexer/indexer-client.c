@@ -74,8 +74,10 @@ indexer_client_request_queue(struct indexer_client *client, bool append,
 }
 
 static int
-indexer_client_request_optimize(struct indexer_client *client,
-				const char *const *args, const char **error_r)
+indexer_client_request_maintenance(struct indexer_client *client,
+				   enum indexer_request_type type,
+				   const char *const *args,
+				   const char **error_r)
 {
 	struct indexer_client_request *ctx = NULL;
 	unsigned int tag;
@@ -97,7 +99,18 @@ indexer_client_request_optimize(struct indexer_client *client,
 		indexer_client_ref(client);
 	}
 
-	indexer_queue_append_optimize(client->queue, args[1], args[2], ctx);
+	switch (type) {
+	case INDEXER_REQUEST_TYPE_INDEX:
+		i_unreached();
+	case INDEXER_REQUEST_TYPE_OPTIMIZE:
+		indexer_queue_append_optimize(client->queue, args[1], args[2],
+					      ctx);
+		break;
+	case INDEXER_REQUEST_TYPE_VERIFY:
+		indexer_queue_append_verify(client->queue, args[1], args[2],
+					    ctx);
+		break;
+	}
 	o_stream_nsend_str(client->conn.output, t_strdup_printf("%u\tOK\n", tag));
 	return 0;
 }
@@ -156,6 +169,9 @@ indexer_client_request_list_write(string_t *str,
 	case INDEXER_REQUEST_TYPE_OPTIMIZE:
 		str_append_c(str, 'o');
 		break;
+	case INDEXER_REQUEST_TYPE_VERIFY:
+		str_append_c(str, 'v');
+		break;
 	}
 	str_append_c(str, '\t');
 	if (request->working)
@@ -227,9 +243,13 @@ indexer_client_request(struct indexer_client *client,
 		return indexer_client_request_queue(client, TRUE, args, error_r);
 	else if (strcmp(cmd, "PREPEND") == 0)
 		return indexer_client_request_queue(client, FALSE, args, error_r);
-	else if (strcmp(cmd, "OPTIMIZE") == 0)
-		return indexer_client_request_optimize(client, args, error_r);
-	else if (strcmp(cmd, "REMOVE") == 0)
+	else if (strcmp(cmd, "OPTIMIZE") == 0) {
+		return indexer_client_request_maintenance(client,
+			INDEXER_REQUEST_TYPE_OPTIMIZE, args, error_r);
+	} else if (strcmp(cmd, "VERIFY") == 0) {
+		return indexer_client_request_maintenance(client,
+			INDEXER_REQUEST_TYPE_VERIFY, args, error_r);
+	} else if (strcmp(cmd, "REMOVE") == 0)
 		return indexer_client_request_remove(client, args, error_r);
 	else if (strcmp(cmd, "LIST") == 0)
 		return indexer_client_request_list(client, args, error_r);
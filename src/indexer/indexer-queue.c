@@ -183,6 +183,18 @@ void indexer_queue_append_optimize(struct indexer_queue *queue,
 	indexer_queue_append_finish(queue);
 }
 
+void indexer_queue_append_verify(struct indexer_queue *queue,
+				 const char *username, const char *mailbox,
+				 void *context)
+{
+	struct indexer_request *request;
+
+	request = indexer_queue_append_request(queue, TRUE, username, mailbox,
+					       NULL, 0, context);
+	request->type = INDEXER_REQUEST_TYPE_VERIFY;
+	indexer_queue_append_finish(queue);
+}
+
 struct indexer_request *indexer_queue_request_peek(struct indexer_queue *queue)
 {
 	return queue->head;
@@ -11,6 +11,8 @@ enum indexer_request_type {
 	INDEXER_REQUEST_TYPE_INDEX,
 	/* optimize the mailbox */
 	INDEXER_REQUEST_TYPE_OPTIMIZE,
+	/* verify the mailbox's index and fsck it if it's broken */
+	INDEXER_REQUEST_TYPE_VERIFY,
 };
 
 struct indexer_request {
@@ -55,6 +57,9 @@ void indexer_queue_append(struct indexer_queue *queue, bool append,
 void indexer_queue_append_optimize(struct indexer_queue *queue,
 				   const char *username, const char *mailbox,
 				   void *context);
+void indexer_queue_append_verify(struct indexer_queue *queue,
+				 const char *username, const char *mailbox,
+				 void *context);
 /* Remove all queued requests for the user. If mailbox_mask is non-NULL, remove
    only requests that match the mailbox mask (with * and ? wildcards). Already
    running requests aren't removed, but their reindex flag is cleared. */
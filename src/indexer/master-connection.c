@@ -22,6 +22,9 @@
 #define INDEXER_PROTOCOL_MAJOR_VERSION 1
 #define INDEXER_PROTOCOL_MINOR_VERSION 0
 
+/* Number of index records to verify between process title updates */
+#define INDEXER_VERIFY_RECORDS_PER_STEP 10000
+
 #define INDEXER_MASTER_NAME "indexer-master-worker"
 #define INDEXER_WORKER_NAME "indexer-worker-master"
 
@@ -224,6 +227,38 @@ index_mailbox_precache(struct master_connection *conn, struct mailbox *box)
 	       index_mailbox_precache_virtual(conn, box);
 }
 
+static int
+index_mailbox_verify(struct mailbox *box)
+{
+	const char *username = box->storage->user->username;
+	const char *box_vname = mailbox_get_vname(box);
+	struct mail_index_verify_ctx *ctx;
+	uint32_t seq = 0, messages_count;
+	int ret;
+
+	/* The index is verified without locking it, so this doesn't block
+	   the user's other processes. fsck is done only if the index is
+	   actually found to be broken. The fscked-flag is left for the
+	   storage's next sync to notice. */
+	messages_count = mail_index_view_get_messages_count(box->view);
+	ctx = mail_index_verify_init(box->index);
+	while ((ret = mail_index_verify_more(ctx,
+			INDEXER_VERIFY_RECORDS_PER_STEP)) == 0) {
+		seq += INDEXER_VERIFY_RECORDS_PER_STEP;
+		indexer_worker_refresh_proctitle(username, box_vname,
+						 seq, messages_count);
+	}
+	mail_index_verify_deinit(&ctx);
+
+	if (ret < 0) {
+		mailbox_set_index_error(box);
+		e_error(box->event, "Index fsck failed: %s",
+			mailbox_get_last_internal_error(box, NULL));
+		return -1;
+	}
+	return 0;
+}
+
 static int
 index_mailbox(struct master_connection *conn, struct mail_user *user,
 	      const char *mailbox, unsigned int max_recent_msgs,
@@ -284,9 +319,15 @@ index_mailbox(struct master_connection *conn, struct mail_user *user,
 			e_debug(box->event, "Syncing failed: %s", errstr);
 		}
 		ret = -1;
-	} else if (strchr(what, 'i') != NULL) {
-		if (index_mailbox_precache(conn, box) < 0)
-			ret = -1;
+	} else {
+		if (strchr(what, 'i') != NULL) {
+			if (index_mailbox_precache(conn, box) < 0)
+				ret = -1;
+		}
+		if (strchr(what, 'v') != NULL) {
+			if (index_mailbox_verify(box) < 0)
+				ret = -1;
+		}
 	}
 	mailbox_free(&box);
 	return ret;
@@ -258,6 +258,34 @@ static void test_indexer_queue_iter(void)
 	test_end();
 }
 
+static void test_indexer_queue_verify(void)
+{
+	struct indexer_queue *queue;
+	struct indexer_request *request;
+
+	test_begin("indexer queue verify");
+	queue = indexer_queue_init(indexer_queue_status_callback);
+
+	indexer_queue_append(queue, TRUE, "user1", "mailbox1", "session1", 0, NULL);
+	indexer_queue_append_verify(queue, "user1", "mailbox2", NULL);
+	test_assert_cmp(indexer_queue_count(queue), ==, 2);
+
+	request = indexer_queue_request_peek(queue);
+	test_assert(request->type == INDEXER_REQUEST_TYPE_INDEX);
+	indexer_queue_request_remove(queue);
+	indexer_queue_request_finish(queue, &request, INDEXER_STATE_COMPLETED);
+
+	request = indexer_queue_request_peek(queue);
+	test_assert_strcmp(request->mailbox, "mailbox2");
+	test_assert(request->type == INDEXER_REQUEST_TYPE_VERIFY);
+	indexer_queue_request_remove(queue);
+	indexer_queue_request_finish(queue, &request, INDEXER_STATE_COMPLETED);
+	test_assert(indexer_queue_request_peek(queue) == NULL);
+
+	indexer_queue_deinit(&queue);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
@@ -266,6 +294,7 @@ int main(void)
 		test_indexer_queue_reindex,
 		test_indexer_queue_cancel,
 		test_indexer_queue_iter,
+		test_indexer_queue_verify,
 		NULL
 	};
 	return test_run(test_functions);
@@ -159,6 +159,9 @@ worker_connection_send_request(struct worker_connection *worker,
 		case INDEXER_REQUEST_TYPE_OPTIMIZE:
 			str_append_c(str, 'o');
 			break;
+		case INDEXER_REQUEST_TYPE_VERIFY:
+			str_append_c(str, 'v');
+			break;
 		}
 		str_append_c(str, '\n');
 		o_stream_nsend(worker->conn.output, str_data(str), str_len(str));
@@ -462,6 +462,23 @@ imap_msgpart_crlf_seek(struct mail *mail, struct istream *input,
 	return crlf_input;
 }
 
+static bool imap_msgpart_mail_has_no_nuls(struct mail *mail)
+{
+	enum mail_lookup_abort orig_lookup_abort = mail->lookup_abort;
+	struct message_part *parts;
+
+	if (mail->has_nuls || mail->has_no_nuls)
+		return mail->has_no_nuls;
+
+	/* The NUL state wasn't in cache flags, but it's known also when the
+	   message parts are cached. Knowing it avoids the nonuls istream,
+	   which would prevent sending the mail with sendfile(). */
+	mail->lookup_abort = MAIL_LOOKUP_ABORT_NOT_IN_CACHE;
+	(void)mail_get_parts(mail, &parts);
+	mail->lookup_abort = orig_lookup_abort;
+	return mail->has_no_nuls;
+}
+
 static void
 imap_msgpart_get_partial(struct mail *mail, const struct imap_msgpart *msgpart,
 			 bool convert_nuls, bool use_partial_cache,
@@ -502,7 +519,7 @@ imap_msgpart_get_partial(struct mail *mail, const struct imap_msgpart *msgpart,
 		result->size = bytes_left;
 	}
 
-	if (!mail->has_no_nuls && convert_nuls) {
+	if (convert_nuls && !imap_msgpart_mail_has_no_nuls(mail)) {
 		/* IMAP literals must not contain NULs. change them to
 		   0x80 characters. */
 		input2 = i_stream_create_nonuls(result->input, '\x80');
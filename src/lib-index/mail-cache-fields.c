@@ -102,6 +102,32 @@ mail_cache_field_update(struct mail_cache *cache,
 				newfield->type, newfield->field_size);
 }
 
+static void
+mail_cache_field_link_compressed(struct mail_cache *cache, unsigned int idx)
+{
+	const char *name = cache->fields[idx].field.name;
+	const char *uncompressed_name;
+	unsigned int other_idx;
+
+	if (str_begins(name, MAIL_CACHE_COMPRESSED_FIELD_PREFIX,
+		       &uncompressed_name)) {
+		other_idx = mail_cache_register_lookup(cache,
+						       uncompressed_name);
+		if (other_idx == UINT_MAX)
+			return;
+		cache->fields[other_idx].compressed_idx = idx;
+		cache->fields[idx].uncompressed_idx = other_idx;
+	} else {
+		other_idx = mail_cache_register_lookup(cache,
+			t_strconcat(MAIL_CACHE_COMPRESSED_FIELD_PREFIX,
+				    name, NULL));
+		if (other_idx == UINT_MAX)
+			return;
+		cache->fields[idx].compressed_idx = other_idx;
+		cache->fields[other_idx].uncompressed_idx = idx;
+	}
+}
+
 void mail_cache_register_fields(struct mail_cache *cache,
 				struct mail_cache_field *fields,
 				unsigned int fields_count,
@@ -109,7 +135,7 @@ void mail_cache_register_fields(struct mail_cache *cache,
 {
 	char *name;
 	void *value;
-	unsigned int new_idx;
+	unsigned int new_idx, orig_count;
 	unsigned int i, j, registered_count;
 
 	struct mail_index_cache_optimization_settings *set =
@@ -165,7 +191,7 @@ void mail_cache_register_fields(struct mail_cache *cache,
 		i_realloc_type(cache->field_file_map, uint32_t,
 			       cache->fields_count, new_idx);
 
-	registered_count = cache->fields_count;
+	orig_count = registered_count = cache->fields_count;
 	for (i = 0; i < fields_count; i++) {
 		unsigned int idx = fields[i].idx;
 
@@ -178,6 +204,8 @@ void mail_cache_register_fields(struct mail_cache *cache,
 		cache->fields[idx].field.name = name;
 		cache->fields[idx].field.last_used = fields[i].last_used;
 		cache->field_file_map[idx] = (uint32_t)-1;
+		cache->fields[idx].compressed_idx = UINT_MAX;
+		cache->fields[idx].uncompressed_idx = UINT_MAX;
 
 		if (!field_has_fixed_size(cache->fields[idx].field.type))
 			cache->fields[idx].field.field_size = UINT_MAX;
@@ -188,6 +216,36 @@ void mail_cache_register_fields(struct mail_cache *cache,
 	}
 	i_assert(registered_count == new_idx);
 	cache->fields_count = new_idx;
+
+	for (i = orig_count; i < new_idx; i++)
+		mail_cache_field_link_compressed(cache, i);
+}
+
+unsigned int
+mail_cache_register_compressed_field(struct mail_cache *cache,
+				     unsigned int field_idx)
+{
+	struct mail_cache_field_private *priv = &cache->fields[field_idx];
+	struct mail_cache_field field;
+
+	i_assert(priv->field.field_size == UINT_MAX);
+	i_assert(priv->uncompressed_idx == UINT_MAX);
+
+	if (priv->compressed_idx != UINT_MAX)
+		return priv->compressed_idx;
+
+	i_zero(&field);
+	field.name = t_strconcat(MAIL_CACHE_COMPRESSED_FIELD_PREFIX,
+				 priv->field.name, NULL);
+	field.type = MAIL_CACHE_FIELD_VARIABLE_SIZE;
+	field.field_size = UINT_MAX;
+	field.decision = priv->field.decision &
+		ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED);
+	field.last_used = priv->field.last_used;
+	mail_cache_register_fields(cache, &field, 1, unsafe_data_stack_pool);
+	/* cache->fields may have been reallocated */
+	i_assert(cache->fields[field_idx].compressed_idx == field.idx);
+	return field.idx;
 }
 
 unsigned int
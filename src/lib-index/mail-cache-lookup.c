@@ -4,8 +4,16 @@
 #include "array.h"
 #include "buffer.h"
 #include "str.h"
+#include "sort.h"
+#include "mmap-util.h"
 #include "mail-cache-private.h"
 
+/* How many bytes to read for each record in mail_cache_prefetch(). Most
+   records are smaller than this. */
+#define MAIL_CACHE_PREFETCH_RECORD_SIZE 4096
+/* Records closer to each other than this are read with a single read. */
+#define MAIL_CACHE_PREFETCH_MAX_GAP (16*1024)
+
 
 #define CACHE_PREFETCH IO_BLOCK_SIZE
 
@@ -314,7 +322,11 @@ int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 		return -1;
 	}
 
-	field_r->field_idx = field_idx;
+	/* return compressed fields as their uncompressed fields */
+	field_r->compressed =
+		cache->fields[field_idx].uncompressed_idx != UINT_MAX;
+	field_r->field_idx = !field_r->compressed ? field_idx :
+		cache->fields[field_idx].uncompressed_idx;
 	field_r->data = CONST_PTR_OFFSET(ctx->rec, ctx->pos);
 	field_r->size = data_size;
 	field_r->offset = ctx->offset + ctx->pos;
@@ -324,6 +336,97 @@ int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 	return 1;
 }
 
+int mail_cache_field_decompress(struct mail_cache *cache,
+				const struct mail_cache_iterate_field *field,
+				buffer_t *dest)
+{
+	const char *error;
+
+	i_assert(field->compressed);
+
+	if (cache->compression == NULL)
+		return 0;
+	if (cache->compression->decompress(cache->compression_context,
+					   field->data, field->size,
+					   dest, &error) < 0) {
+		mail_cache_set_corrupted(cache,
+			"Failed to decompress field %s: %s",
+			cache->fields[field->field_idx].field.name, error);
+		return -1;
+	}
+	return 1;
+}
+
+static void
+mail_cache_prefetch_range(struct mail_cache *cache, uoff_t start, uoff_t end)
+{
+	const void *data;
+	size_t page_size, page_offset;
+
+	if (MAIL_CACHE_IS_UNUSABLE(cache))
+		return;
+	/* with file_cache this reads the range into memory */
+	if (mail_cache_map(cache, start, end - start, &data) < 0 ||
+	    cache->mmap_base == NULL)
+		return;
+	if (start >= cache->mmap_length)
+		return;
+	if (end > cache->mmap_length)
+		end = cache->mmap_length;
+
+	page_size = mmap_get_page_size();
+	page_offset = start % page_size;
+	(void)posix_madvise(PTR_OFFSET(cache->mmap_base, start - page_offset),
+			    end - start + page_offset, POSIX_MADV_WILLNEED);
+}
+
+void mail_cache_prefetch(struct mail_cache_view *view,
+			 uint32_t seq1, uint32_t seq2)
+{
+	struct mail_cache *cache = view->cache;
+	ARRAY(uint32_t) offsets;
+	const uint32_t *offsetp;
+	uint32_t seq, offset;
+	uoff_t start = 0, end = 0;
+	int ret;
+
+	if (!cache->opened)
+		(void)mail_cache_open_and_verify(cache);
+	if (MAIL_CACHE_IS_UNUSABLE(cache) || cache->map_with_read)
+		return;
+
+	seq2 = I_MIN(seq2, mail_index_view_get_messages_count(view->view));
+	if (seq1 > seq2)
+		return;
+
+	T_BEGIN {
+		t_array_init(&offsets, seq2 - seq1 + 1);
+		for (seq = seq1; seq <= seq2; seq++) {
+			ret = mail_cache_lookup_offset(cache, view->view,
+						       seq, &offset);
+			if (ret < 0 || MAIL_CACHE_IS_UNUSABLE(cache))
+				break;
+			if (ret > 0)
+				array_push_back(&offsets, &offset);
+		}
+		array_sort(&offsets, uint32_cmp);
+
+		array_foreach(&offsets, offsetp) {
+			if (end != 0 &&
+			    *offsetp <= end + MAIL_CACHE_PREFETCH_MAX_GAP) {
+				end = *offsetp + MAIL_CACHE_PREFETCH_RECORD_SIZE;
+				continue;
+			}
+			if (end != 0)
+				mail_cache_prefetch_range(cache, start, end);
+			start = *offsetp;
+			end = start + MAIL_CACHE_PREFETCH_RECORD_SIZE;
+		}
+		if (end != 0)
+			mail_cache_prefetch_range(cache, start, end);
+	} T_END;
+}
+
 static int mail_cache_seq(struct mail_cache_view *view, uint32_t seq)
 {
 	struct mail_cache_lookup_iterate_ctx iter;
@@ -340,6 +443,11 @@ static int mail_cache_seq(struct mail_cache_view *view, uint32_t seq)
 
 	mail_cache_lookup_iter_init(view, seq, &iter);
 	while ((ret = mail_cache_lookup_iter_next(&iter, &field)) > 0) {
+		if (field.compressed && view->cache->compression == NULL) {
+			/* can't be read, so treat it as not cached. this
+			   allows the field to be added again uncompressed. */
+			continue;
+		}
 		buffer_write(view->cached_exists_buf, field.field_idx,
 			     &view->cached_exists_value, 1);
 	}
@@ -434,10 +542,21 @@ int mail_cache_lookup_field(struct mail_cache_view *view, buffer_t *dest_buf,
 		/* return the first one that's found. if there are multiple
 		   they're all identical. */
 		while ((ret = mail_cache_lookup_iter_next(&iter, &field)) > 0) {
-			if (field.field_idx == field_idx) {
+			if (field.field_idx != field_idx)
+				continue;
+			if (!field.compressed)
 				buffer_append(dest_buf, field.data, field.size);
-				break;
+			else {
+				ret = mail_cache_field_decompress(view->cache,
+								  &field,
+								  dest_buf);
+				if (ret == 0) {
+					/* there may still be an uncompressed
+					   copy of the field */
+					continue;
+				}
 			}
+			break;
 		}
 	}
 	/* NOTE: view->cache->fields may have been reallocated by
@@ -555,9 +674,22 @@ mail_cache_lookup_headers_real(struct mail_cache_view *view, string_t *dest,
 		if (field.field_idx > max_field ||
 		    field_state[field.field_idx] != HDR_FIELD_STATE_WANT) {
 			/* a) don't want it, b) duplicate */
-		} else {
+		} else if (!field.compressed) {
 			field_state[field.field_idx] = HDR_FIELD_STATE_SEEN;
 			header_lines_save(&ctx, &field);
+		} else {
+			buffer_t *decompressed = t_buffer_create(field.size * 4);
+
+			ret = mail_cache_field_decompress(view->cache, &field,
+							  decompressed);
+			if (ret < 0)
+				break;
+			if (ret > 0) {
+				field.data = decompressed->data;
+				field.size = decompressed->used;
+				field_state[field.field_idx] = HDR_FIELD_STATE_SEEN;
+				header_lines_save(&ctx, &field);
+			}
 		}
 
 	}
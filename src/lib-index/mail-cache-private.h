@@ -13,6 +13,11 @@
 
 #define MAIL_CACHE_MAX_WRITE_BUFFER (1024*256)
 
+/* Compressed data for a variable sized field is stored in a separate field,
+   which is named with this prefix. Older versions see it as just another
+   field that nobody looks up. */
+#define MAIL_CACHE_COMPRESSED_FIELD_PREFIX "compressed."
+
 #define MAIL_CACHE_IS_UNUSABLE(cache) \
 	((cache)->hdr == NULL)
 
@@ -114,6 +119,13 @@ struct mail_cache_field_private {
 	   decision to change from TEMP to YES. */
 	uint32_t uid_highwater;
 
+	/* Field containing this field's compressed data, or UINT_MAX if it
+	   isn't registered. */
+	unsigned int compressed_idx;
+	/* If this is a compressed field, the field whose data it contains.
+	   Otherwise UINT_MAX. */
+	unsigned int uncompressed_idx;
+
 	/* Unused fields aren't written to cache file */
 	bool used:1;
 	/* field.decision is pending a write to cache file header. If the
@@ -121,6 +133,12 @@ struct mail_cache_field_private {
 	bool decision_dirty:1;
 };
 
+struct mail_cache_compression_registration {
+	const struct mail_cache_compression *compression;
+	void *context;
+	unsigned int min_size;
+};
+
 struct mail_cache {
 	struct mail_index *index;
 	struct event *event;
@@ -196,6 +214,13 @@ struct mail_cache {
 	/* Human-readable reason for purging. Used for debugging and events. */
 	char *need_purge_reason;
 
+	/* All mail_cache_register_compression() registrations */
+	ARRAY(struct mail_cache_compression_registration) compression_registrations;
+	/* Copied from the latest registration, NULL if there are none */
+	const struct mail_cache_compression *compression;
+	void *compression_context;
+	unsigned int compression_min_size;
+
 	/* Cache has been opened (or it doesn't exist). */
 	bool opened:1;
 	/* Cache has been locked with mail_cache_lock(). */
@@ -281,6 +306,9 @@ struct mail_cache_iterate_field {
 	const void *data;
 	/* Offset to data in cache file */
 	uoff_t offset;
+	/* Data is from field_idx's compressed field. Use
+	   mail_cache_field_decompress() to access it. */
+	bool compressed;
 };
 
 struct mail_cache_lookup_iterate_ctx {
@@ -342,6 +370,12 @@ int mail_cache_write(struct mail_cache *cache, const void *data, size_t size,
 int mail_cache_append(struct mail_cache *cache, const void *data, size_t size,
 		      uint32_t *offset);
 
+/* Returns the field containing field_idx's compressed data. It's registered
+   if it doesn't exist yet. */
+unsigned int
+mail_cache_register_compressed_field(struct mail_cache *cache,
+				     unsigned int field_idx);
+
 int mail_cache_header_fields_read(struct mail_cache *cache);
 int mail_cache_header_fields_update(struct mail_cache *cache);
 void mail_cache_header_fields_get(struct mail_cache *cache, buffer_t *dest);
@@ -368,6 +402,11 @@ void mail_cache_lookup_iter_init(struct mail_cache_view *view, uint32_t seq,
    Note that this may trigger re-reading and reallocating cache fields. */
 int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 				struct mail_cache_iterate_field *field_r);
+/* Append the compressed field's decompressed data to dest. Returns 1 if ok,
+   0 if decompression isn't possible currently, -1 if the data is corrupted. */
+int mail_cache_field_decompress(struct mail_cache *cache,
+				const struct mail_cache_iterate_field *field,
+				buffer_t *dest);
 const struct mail_cache_record *
 mail_cache_transaction_lookup_rec(struct mail_cache_transaction_ctx *ctx,
 				  unsigned int seq,
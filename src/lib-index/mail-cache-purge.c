@@ -8,6 +8,7 @@
 #include "file-dotlock.h"
 #include "file-cache.h"
 #include "file-set-size.h"
+#include "mmap-util.h"
 #include "mail-cache-private.h"
 
 #include <stdio.h>
@@ -51,9 +52,18 @@ mail_cache_purge_field(struct mail_cache_copy_context *ctx,
         struct mail_cache_field *cache_field;
 	enum mail_cache_decision_type dec;
 	uint32_t file_field_idx, size32;
+	unsigned int field_idx;
 	uint8_t *field_seen;
 
-	file_field_idx = ctx->field_file_map[field->field_idx];
+	if (field->compressed && ctx->cache->compression == NULL) {
+		/* Can't be read currently. Drop it, since the field may also
+		   have been added again uncompressed. */
+		return;
+	}
+	/* compressed fields are copied as they are */
+	field_idx = !field->compressed ? field->field_idx :
+		ctx->cache->fields[field->field_idx].compressed_idx;
+	file_field_idx = ctx->field_file_map[field_idx];
 	if (file_field_idx == (uint32_t)-1)
 		return;
 
@@ -198,6 +208,25 @@ mail_cache_purge_check_field(struct mail_cache_copy_context *ctx,
 	return priv->used;
 }
 
+static bool
+mail_cache_purge_check_compressed_field(struct mail_cache_copy_context *ctx,
+					unsigned int field)
+{
+	struct mail_cache_field_private *priv = &ctx->cache->fields[field];
+	const struct mail_cache_field_private *uncompressed_priv =
+		&ctx->cache->fields[priv->uncompressed_idx];
+
+	/* The compressed field is kept as long as its uncompressed field.
+	   Its decision isn't used for anything, but keep it in sync for
+	   older versions that see it as a separate field. */
+	if (ctx->field_file_map[priv->uncompressed_idx] == (uint32_t)-1)
+		priv->used = FALSE;
+	priv->field.decision = uncompressed_priv->field.decision &
+		ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED);
+	priv->field.last_used = uncompressed_priv->field.last_used;
+	return priv->used;
+}
+
 static int
 mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 		struct event *event, int fd, const char *reason,
@@ -264,7 +293,17 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 		used_fields_count = i;
 	} else {
 		for (i = used_fields_count = 0; i < orig_fields_count; i++) {
-			if (!mail_cache_purge_check_field(&ctx, i))
+			if (cache->fields[i].uncompressed_idx != UINT_MAX) {
+				/* compressed field - handled below */
+			} else if (!mail_cache_purge_check_field(&ctx, i))
+				ctx.field_file_map[i] = (uint32_t)-1;
+			else
+				ctx.field_file_map[i] = used_fields_count++;
+		}
+		for (i = 0; i < orig_fields_count; i++) {
+			if (cache->fields[i].uncompressed_idx == UINT_MAX)
+				continue;
+			if (!mail_cache_purge_check_compressed_field(&ctx, i))
 				ctx.field_file_map[i] = (uint32_t)-1;
 			else
 				ctx.field_file_map[i] = used_fields_count++;
@@ -525,6 +564,17 @@ static int mail_cache_purge_locked(struct mail_cache *cache,
 		/* make sure we have mapped it before reading. */
 		if (mail_cache_map_all(cache) <= 0)
 			return -1;
+		/* The records are mostly copied in the order they were
+		   written. Let the kernel read ahead, and drop the old file's
+		   pages soon after they've been copied. */
+		if (cache->file_cache == NULL &&
+		    cache->mmap_length > mmap_get_page_size()) {
+			errno = posix_madvise(cache->mmap_base,
+					      cache->mmap_length,
+					      POSIX_MADV_SEQUENTIAL);
+			if (errno != 0)
+				mail_cache_set_syscall_error(cache, "posix_madvise()");
+		}
 	}
 
 	/* we want to recreate the cache. write it first to a temporary file */
@@ -721,6 +771,10 @@ mail_cache_purge_drop_test(struct mail_cache_purge_drop_ctx *ctx,
 
 	if ((dec & MAIL_CACHE_DECISION_FORCED) != 0)
 		return MAIL_CACHE_PURGE_DROP_DECISION_NONE;
+	if (priv->uncompressed_idx != UINT_MAX) {
+		/* dropped along with the uncompressed field */
+		return MAIL_CACHE_PURGE_DROP_DECISION_NONE;
+	}
 	if (dec != MAIL_CACHE_DECISION_NO &&
 	    priv->field.last_used < ctx->max_temp_drop_time) {
 		/* YES or TEMP decision field hasn't been accessed for a long
@@ -38,6 +38,8 @@ struct mail_cache_transaction_ctx {
 	uint32_t first_new_seq;
 
 	buffer_t *cache_data;
+	/* Temporary buffer for compressing fields in mail_cache_add() */
+	buffer_t *compress_buf;
 	ARRAY(uint8_t) cache_field_idx_used;
 	ARRAY(struct mail_cache_transaction_rec) cache_data_seq;
 	ARRAY_TYPE(seq_range) cache_data_wanted_seqs;
@@ -180,6 +182,7 @@ void mail_cache_transaction_rollback(struct mail_cache_transaction_ctx **_ctx)
 
 	mail_index_view_close(&ctx->view->trans_view);
 	buffer_free(&ctx->cache_data);
+	buffer_free(&ctx->compress_buf);
 	if (array_is_created(&ctx->cache_data_seq))
 		array_free(&ctx->cache_data_seq);
 	if (array_is_created(&ctx->cache_data_wanted_seqs))
@@ -774,11 +777,43 @@ mail_cache_transaction_refresh_decisions(struct mail_cache_transaction_ctx *ctx)
 	ctx->decisions_refreshed = TRUE;
 }
 
+static bool
+mail_cache_transaction_compress(struct mail_cache_transaction_ctx *ctx,
+				const void **data, size_t *data_size)
+{
+	struct mail_cache *cache = ctx->cache;
+	const char *error;
+
+	if (cache->compression == NULL ||
+	    cache->compression->compress == NULL ||
+	    *data_size < cache->compression_min_size)
+		return FALSE;
+
+	if (ctx->compress_buf == NULL)
+		ctx->compress_buf = buffer_create_dynamic(default_pool, 1024);
+	else
+		buffer_set_used_size(ctx->compress_buf, 0);
+	if (cache->compression->compress(cache->compression_context,
+					 *data, *data_size,
+					 ctx->compress_buf, &error) < 0) {
+		e_error(cache->event, "Failed to compress cache field: %s",
+			error);
+		return FALSE;
+	}
+	if (ctx->compress_buf->used >= *data_size) {
+		/* not worth it */
+		return FALSE;
+	}
+	*data = ctx->compress_buf->data;
+	*data_size = ctx->compress_buf->used;
+	return TRUE;
+}
+
 void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 		    unsigned int field_idx, const void *data, size_t data_size)
 {
 	uint32_t data_size32;
-	unsigned int fixed_size;
+	unsigned int fixed_size, write_field_idx;
 	size_t full_size, record_size;
 
 	i_assert(field_idx < ctx->cache->fields_count);
@@ -804,6 +839,14 @@ void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 	fixed_size = ctx->cache->fields[field_idx].field.field_size;
 	i_assert(fixed_size == UINT_MAX || fixed_size == data_size);
 
+	/* compressed data is written to a separate field */
+	write_field_idx = field_idx;
+	if (fixed_size == UINT_MAX &&
+	    mail_cache_transaction_compress(ctx, &data, &data_size)) {
+		write_field_idx =
+			mail_cache_register_compressed_field(ctx->cache,
+							     field_idx);
+	}
 	data_size32 = (uint32_t)data_size;
 	full_size = sizeof(field_idx) + ((data_size + 3) & ~3U);
 	if (fixed_size == UINT_MAX)
@@ -836,6 +879,10 @@ void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 	   setting it here, because cache purging may run and clear it. */
 	uint8_t field_idx_set = 1;
 	array_idx_set(&ctx->cache_field_idx_used, field_idx, &field_idx_set);
+	/* The compressed field is purged along with the uncompressed field,
+	   so both of them need to be in the cache file. */
+	array_idx_set(&ctx->cache_field_idx_used, write_field_idx,
+		      &field_idx_set);
 
 	/* Remember that this value exists for the mail, in case we try to look
 	   it up. Note that this gets forgotten whenever changing the mail. */
@@ -870,7 +917,8 @@ void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 		}
 	}
 
-	buffer_append(ctx->cache_data, &field_idx, sizeof(field_idx));
+	buffer_append(ctx->cache_data, &write_field_idx,
+		      sizeof(write_field_idx));
 	if (fixed_size == UINT_MAX) {
 		buffer_append(ctx->cache_data, &data_size32,
 			      sizeof(data_size32));
@@ -622,6 +622,8 @@ void mail_cache_free(struct mail_cache **_cache)
 	mail_cache_file_close(cache);
 
 	buffer_free(&cache->read_buf);
+	if (array_is_created(&cache->compression_registrations))
+		array_free(&cache->compression_registrations);
 	hash_table_destroy(&cache->field_name_hash);
 	pool_unref(&cache->field_pool);
 	event_unref(&cache->event);
@@ -633,19 +635,73 @@ void mail_cache_free(struct mail_cache **_cache)
 	i_free(cache);
 }
 
-static int mail_cache_lock_file(struct mail_cache *cache)
+static void mail_cache_compression_update(struct mail_cache *cache)
 {
-	unsigned int timeout_secs;
-	bool nonblock = FALSE;
-	int ret;
+	const struct mail_cache_compression_registration *reg;
+	struct mail_cache_view *view;
+	bool had_compression = cache->compression != NULL;
+
+	if (array_is_empty(&cache->compression_registrations)) {
+		cache->compression = NULL;
+		cache->compression_context = NULL;
+		cache->compression_min_size = 0;
+	} else {
+		reg = array_back(&cache->compression_registrations);
+		cache->compression = reg->compression;
+		cache->compression_context = reg->context;
+		cache->compression_min_size = reg->min_size;
+	}
 
-	if (cache->last_lock_failed) {
-		/* previous locking failed. don't waste time waiting on it
-		   again, just try once to see if it's available now. */
-		nonblock = TRUE;
+	if (had_compression != (cache->compression != NULL)) {
+		/* whether compressed fields exist depends on whether they
+		   can be decompressed */
+		for (view = cache->views; view != NULL; view = view->next)
+			view->cached_exists_seq = 0;
 	}
+}
+
+void mail_cache_register_compression(struct mail_cache *cache,
+				     const struct mail_cache_compression *compression,
+				     void *context, unsigned int min_size)
+{
+	struct mail_cache_compression_registration *reg;
+
+	i_assert(compression->decompress != NULL);
+
+	if (!array_is_created(&cache->compression_registrations))
+		i_array_init(&cache->compression_registrations, 4);
+	reg = array_append_space(&cache->compression_registrations);
+	reg->compression = compression;
+	reg->context = context;
+	reg->min_size = min_size;
+	mail_cache_compression_update(cache);
+}
+
+void mail_cache_unregister_compression(struct mail_cache *cache,
+				       void *context)
+{
+	const struct mail_cache_compression_registration *regs;
+	unsigned int i, count;
+
+	i_assert(array_is_created(&cache->compression_registrations));
+
+	regs = array_get(&cache->compression_registrations, &count);
+	for (i = count; i > 0; i--) {
+		if (regs[i-1].context == context) {
+			array_delete(&cache->compression_registrations,
+				     i-1, 1);
+			mail_cache_compression_update(cache);
+			return;
+		}
+	}
+	i_unreached();
+}
+
+static int mail_cache_lock_file_try(struct mail_cache *cache, bool nonblock)
+{
+	unsigned int timeout_secs;
+	int ret;
 
-	i_assert(cache->file_lock == NULL);
 	if (cache->index->set.lock_method != FILE_LOCK_METHOD_DOTLOCK) {
 		timeout_secs = I_MIN(MAIL_CACHE_LOCK_TIMEOUT,
 				     cache->index->set.max_lock_timeout_secs);
@@ -668,6 +724,36 @@ static int mail_cache_lock_file(struct mail_cache *cache)
 						     "file_dotlock_create()");
 		}
 	}
+	return ret;
+}
+
+static bool mail_cache_is_being_purged(struct mail_cache *cache)
+{
+	const char *temp_path = t_strconcat(cache->filepath, ".tmp", NULL);
+	struct stat st;
+
+	/* Purging keeps the cache locked while it writes the new cache file
+	   to the temp file. With large cache files this can take a long
+	   time. Ignore temp files that haven't been written to for a while,
+	   since they were probably left behind by a crash. */
+	if (nfs_safe_stat(temp_path, &st) < 0)
+		return FALSE;
+	return st.st_mtime > ioloop_time - MAIL_CACHE_LOCK_CHANGE_TIMEOUT;
+}
+
+static int mail_cache_lock_file(struct mail_cache *cache)
+{
+	int ret;
+
+	i_assert(cache->file_lock == NULL);
+	ret = mail_cache_lock_file_try(cache, TRUE);
+	/* If the previous locking failed, don't waste time waiting on it
+	   again. Don't wait while the cache is being purged either - it's
+	   better to drop the cache updates than to stall until the purge
+	   is finished. */
+	if (ret == 0 && !cache->last_lock_failed &&
+	    !mail_cache_is_being_purged(cache))
+		ret = mail_cache_lock_file_try(cache, FALSE);
 	cache->last_lock_failed = ret <= 0;
 
 	/* don't bother warning if locking failed due to a timeout. since cache
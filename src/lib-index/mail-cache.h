@@ -64,6 +64,17 @@ struct mail_cache_field {
 	time_t last_used;
 };
 
+struct mail_cache_compression {
+	/* Append compressed data to dest. Returns 0 on success, -1 if the
+	   data couldn't be compressed. */
+	int (*compress)(void *context, const void *data, size_t size,
+			buffer_t *dest, const char **error_r);
+	/* Append decompressed data to dest. Returns 0 on success, -1 if the
+	   data is invalid. */
+	int (*decompress)(void *context, const void *data, size_t size,
+			  buffer_t *dest, const char **error_r);
+};
+
 struct mail_cache *mail_cache_open_or_create(struct mail_index *index);
 struct mail_cache *
 mail_cache_open_or_create_path(struct mail_index *index, const char *path);
@@ -91,6 +102,25 @@ struct mail_cache_field *
 mail_cache_register_get_list(struct mail_cache *cache, pool_t *pool_r,
 			     unsigned int *count_r);
 
+/* Register functions for compressing and decompressing variable sized
+   fields. Fields that are at least min_size bytes are compressed when they're
+   added to the cache, unless compress is NULL. Compressed fields that are
+   looked up while decompression isn't registered are treated as if they
+   weren't cached at all. The compressed data is stored in a separate
+   "compressed.<name>" field, which older Dovecot versions simply ignore.
+
+   The cache is shared by all the opened instances of the same mailbox, which
+   may even belong to different users. Each instance should register when
+   it's opened and unregister when it's closed. The latest registration that
+   is still registered is used, so the context needs to stay valid only until
+   it's unregistered. */
+void mail_cache_register_compression(struct mail_cache *cache,
+				     const struct mail_cache_compression *compression,
+				     void *context, unsigned int min_size);
+/* Unregister a registration with the given context. */
+void mail_cache_unregister_compression(struct mail_cache *cache,
+				       void *context);
+
 /* Returns TRUE if cache should be purged. */
 bool mail_cache_need_purge(struct mail_cache *cache, const char **reason_r);
 /* Set cache file to be purged later. */
@@ -158,6 +188,11 @@ bool mail_cache_field_can_add(struct mail_cache_transaction_ctx *ctx,
 void mail_cache_close_mail(struct mail_cache_transaction_ctx *ctx,
 			   uint32_t seq);
 
+/* Read the cache records of messages seq1..seq2 into memory in the order
+   they are in the cache file. This avoids random reads when the fields are
+   looked up for each message afterwards. */
+void mail_cache_prefetch(struct mail_cache_view *view,
+			 uint32_t seq1, uint32_t seq2);
 /* Returns 1 if field exists, 0 if not, -1 if error. */
 int mail_cache_field_exists(struct mail_cache_view *view, uint32_t seq,
 			    unsigned int field_idx);
@@ -6,6 +6,17 @@
 #include "mail-index-private.h"
 #include "mail-transaction-log-private.h"
 
+struct mail_index_verify_ctx {
+	struct mail_index_view *view;
+
+	uint32_t seq, last_uid;
+	uint32_t seen_count, deleted_count;
+	uint32_t first_unseen_uid, first_deleted_uid;
+
+	bool corrupted:1;
+	bool finished:1;
+};
+
 static void mail_index_fsck_error(struct mail_index *index,
 				  const char *fmt, ...) ATTR_FORMAT(2, 3);
 static void mail_index_fsck_error(struct mail_index *index,
@@ -363,6 +374,7 @@ mail_index_fsck_records(struct mail_index *index, struct mail_index_map *map,
 			memmove(rec, next_rec, hdr->record_size *
 				(map->rec_map->records_count - i - 1));
 			map->rec_map->records_count--;
+			mail_index_record_map_uids_changed(map->rec_map);
 			records_dropped = TRUE;
 			continue;
 		}
@@ -486,6 +498,133 @@ void mail_index_fsck_locked(struct mail_index *index)
 	i_assert(ret == 0);
 }
 
+struct mail_index_verify_ctx *mail_index_verify_init(struct mail_index *index)
+{
+	struct mail_index_verify_ctx *ctx;
+
+	ctx = i_new(struct mail_index_verify_ctx, 1);
+	ctx->view = mail_index_view_open(index);
+	ctx->seq = 1;
+	return ctx;
+}
+
+static void
+mail_index_verify_error(struct mail_index_verify_ctx *ctx,
+			const char *fmt, ...) ATTR_FORMAT(2, 3);
+static void
+mail_index_verify_error(struct mail_index_verify_ctx *ctx,
+			const char *fmt, ...)
+{
+	struct mail_index *index = ctx->view->index;
+	va_list va;
+
+	va_start(va, fmt);
+	mail_index_set_error(index, "Corrupted index file %s: %s",
+			     index->filepath, t_strdup_vprintf(fmt, va));
+	va_end(va);
+	ctx->corrupted = TRUE;
+}
+
+static void mail_index_verify_header(struct mail_index_verify_ctx *ctx)
+{
+	struct mail_index_map *map = ctx->view->map;
+	const struct mail_index_header *hdr = &map->hdr;
+
+	if (hdr->next_uid <= ctx->last_uid) {
+		mail_index_verify_error(ctx, "next_uid %u <= last UID %u",
+					hdr->next_uid, ctx->last_uid);
+		return;
+	}
+	if (map != ctx->view->index->map) {
+		/* The index has been synced since we started. Flag changes
+		   may have been written to the records we already counted,
+		   so the counters can't be compared. */
+		return;
+	}
+	if (hdr->seen_messages_count != ctx->seen_count) {
+		mail_index_verify_error(ctx, "seen_messages_count %u != %u",
+					hdr->seen_messages_count,
+					ctx->seen_count);
+	} else if (hdr->deleted_messages_count != ctx->deleted_count) {
+		mail_index_verify_error(ctx, "deleted_messages_count %u != %u",
+					hdr->deleted_messages_count,
+					ctx->deleted_count);
+	} else if (ctx->first_unseen_uid != 0 &&
+		   hdr->first_unseen_uid_lowwater > ctx->first_unseen_uid) {
+		mail_index_verify_error(ctx,
+			"first_unseen_uid_lowwater %u > %u",
+			hdr->first_unseen_uid_lowwater,
+			ctx->first_unseen_uid);
+	} else if (ctx->first_deleted_uid != 0 &&
+		   hdr->first_deleted_uid_lowwater > ctx->first_deleted_uid) {
+		mail_index_verify_error(ctx,
+			"first_deleted_uid_lowwater %u > %u",
+			hdr->first_deleted_uid_lowwater,
+			ctx->first_deleted_uid);
+	}
+}
+
+int mail_index_verify_more(struct mail_index_verify_ctx *ctx,
+			   unsigned int max_records)
+{
+	struct mail_index_map *map = ctx->view->map;
+	const struct mail_index_record *rec;
+	uint32_t end_seq;
+
+	i_assert(max_records > 0);
+
+	if (ctx->finished)
+		return 1;
+
+	end_seq = ctx->seq + I_MIN(max_records,
+				   map->hdr.messages_count - ctx->seq + 1);
+	for (; ctx->seq < end_seq && !ctx->corrupted; ctx->seq++) {
+		rec = MAIL_INDEX_REC_AT_SEQ(map, ctx->seq);
+		if (rec->uid == 0) {
+			mail_index_verify_error(ctx, "Record [%u].uid=0",
+						ctx->seq);
+			break;
+		}
+		if (rec->uid <= ctx->last_uid) {
+			mail_index_verify_error(ctx,
+				"Record [%u].uid=%u isn't higher than %u",
+				ctx->seq, rec->uid, ctx->last_uid);
+			break;
+		}
+		ctx->last_uid = rec->uid;
+		if ((rec->flags & MAIL_SEEN) != 0)
+			ctx->seen_count++;
+		else if (ctx->first_unseen_uid == 0)
+			ctx->first_unseen_uid = rec->uid;
+		if ((rec->flags & MAIL_DELETED) != 0) {
+			ctx->deleted_count++;
+			if (ctx->first_deleted_uid == 0)
+				ctx->first_deleted_uid = rec->uid;
+		}
+	}
+	if (!ctx->corrupted) {
+		if (ctx->seq <= map->hdr.messages_count)
+			return 0;
+		mail_index_verify_header(ctx);
+	}
+	ctx->finished = TRUE;
+
+	if (ctx->corrupted) {
+		if (mail_index_fsck(ctx->view->index) < 0)
+			return -1;
+	}
+	return 1;
+}
+
+void mail_index_verify_deinit(struct mail_index_verify_ctx **_ctx)
+{
+	struct mail_index_verify_ctx *ctx = *_ctx;
+
+	*_ctx = NULL;
+	mail_index_view_close(&ctx->view);
+	i_free(ctx);
+}
+
 bool mail_index_reset_fscked(struct mail_index *index)
 {
 	bool ret = index->fscked;
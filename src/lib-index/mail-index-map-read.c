@@ -104,6 +104,7 @@ static int mail_index_mmap(struct mail_index_map *map, uoff_t file_size)
 	buffer_append(map->hdr_copy_buf, rec_map->mmap_base, hdr->header_size);
 
 	rec_map->records = PTR_OFFSET(rec_map->mmap_base, map->hdr.header_size);
+	mail_index_record_map_uids_changed(rec_map);
 	return 1;
 }
 
@@ -246,6 +247,7 @@ mail_index_try_read_map(struct mail_index_map *map,
 	map->rec_map->records =
 		buffer_get_modifiable_data(map->rec_map->buffer, NULL);
 	map->rec_map->records_count = records_count;
+	mail_index_record_map_uids_changed(map->rec_map);
 
 	mail_index_map_copy_hdr(map, hdr);
 	i_assert(map->hdr_copy_buf->used == map->hdr.header_size);
@@ -473,6 +475,41 @@ mail_index_map_latest_sync(struct mail_index *index,
 	return ret;
 }
 
+static bool mail_index_map_want_mmap_reopen(struct mail_index *index)
+{
+	struct mail_index_map *map = index->map;
+	struct stat st1, st2;
+
+	if ((index->flags & MAIL_INDEX_OPEN_FLAG_MMAP_DISABLE) != 0 ||
+	    MAIL_INDEX_IS_IN_MEMORY(index) || index->log_sync_locked)
+		return FALSE;
+	if (map->rec_map->mmap_base != NULL) {
+		/* the records are still shared with other processes */
+		return FALSE;
+	}
+	if (map->hdr.header_size + (uoff_t)map->rec_map->records_count *
+	    map->hdr.record_size <= MAIL_INDEX_MMAP_MIN_SIZE) {
+		/* wouldn't have been mmap()ed anyway */
+		return FALSE;
+	}
+
+	/* The records have been copied to our private memory (e.g. because
+	   of appends or expunges). If the index file has been recreated
+	   since then, mmap() it again so the pages are shared with all the
+	   other processes that have the same index open. Only the changes
+	   after it need to be synced from the transaction log. */
+	if (nfs_safe_stat(index->filepath, &st1) < 0)
+		return FALSE;
+	if (index->fd == -1) {
+		/* we created the index file ourself */
+		return TRUE;
+	}
+	if (fstat(index->fd, &st2) < 0)
+		return FALSE;
+	return st1.st_ino != st2.st_ino ||
+		!CMP_DEV_T(st1.st_dev, st2.st_dev);
+}
+
 static int
 mail_index_map_real(struct mail_index *index,
 		    enum mail_index_sync_handler_type type)
@@ -495,6 +532,9 @@ mail_index_map_real(struct mail_index *index,
 		/* it's likely more efficient to reopen the index file than
 		   sync from the transaction log. */
 		ret = 0;
+	} else if (mail_index_map_want_mmap_reopen(index)) {
+		/* release our private copy of the records */
+		ret = 0;
 	} else {
 		/* sync the map from the transaction log. */
 		ret = mail_index_sync_map(&index->map, type, &reason);
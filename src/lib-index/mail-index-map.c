@@ -279,6 +279,8 @@ static void mail_index_record_map_free(struct mail_index_map *map,
 		rec_map->mmap_base = NULL;
 	}
 	array_free(&rec_map->maps);
+	if (array_is_created(&rec_map->uid_samples))
+		array_free(&rec_map->uid_samples);
 	i_free(rec_map);
 }
 
@@ -316,18 +318,21 @@ void mail_index_unmap(struct mail_index_map **_map)
 
 static void mail_index_map_copy_records(struct mail_index_record_map *dest,
 					const struct mail_index_record_map *src,
+					unsigned int records_count,
 					unsigned int record_size)
 {
 	size_t size;
 
-	size = src->records_count * record_size;
+	i_assert(records_count <= src->records_count);
+
+	size = records_count * record_size;
 	/* +1% so we have a bit of space to grow. useful for huge mailboxes. */
 	dest->buffer = buffer_create_dynamic(default_pool,
 					     size + I_MAX(size/100, 1024));
 	buffer_append(dest->buffer, src->records, size);
 
 	dest->records = buffer_get_modifiable_data(dest->buffer, NULL);
-	dest->records_count = src->records_count;
+	dest->records_count = records_count;
 }
 
 static void mail_index_map_copy_header(struct mail_index_map *dest,
@@ -420,12 +425,15 @@ void mail_index_record_map_move_to_private(struct mail_index_map *map)
 {
 	struct mail_index_record_map *new_map;
 	const struct mail_index_record *rec;
+	unsigned int old_records_count = map->rec_map->records_count;
 
 	if (array_count(&map->rec_map->maps) > 1) {
 		/* Multiple references to the rec_map. Create a clone of the
-		   rec_map, which is in memory. */
+		   rec_map, which is in memory. Copy only the records that
+		   this map can see - the rest would be truncated below. */
 		new_map = mail_index_record_map_alloc(map);
 		mail_index_map_copy_records(new_map, map->rec_map,
+					    map->hdr.messages_count,
 					    map->hdr.record_size);
 		mail_index_record_map_unlink(map);
 		map->rec_map = new_map;
@@ -433,12 +441,13 @@ void mail_index_record_map_move_to_private(struct mail_index_map *map)
 		new_map = map->rec_map;
 	}
 
-	if (new_map->records_count != map->hdr.messages_count) {
+	if (old_records_count != map->hdr.messages_count) {
 		/* The rec_map has more messages than what map contains.
 		   These messages aren't necessary (and may confuse the caller),
 		   so truncate them away. */
-		i_assert(new_map->records_count > map->hdr.messages_count);
+		i_assert(old_records_count > map->hdr.messages_count);
 		new_map->records_count = map->hdr.messages_count;
+		mail_index_record_map_uids_changed(new_map);
 		if (new_map->records_count == 0)
 			new_map->last_appended_uid = 0;
 		else {
@@ -469,6 +478,7 @@ void mail_index_map_move_to_memory(struct mail_index_map *map)
 	}
 
 	mail_index_map_copy_records(new_map, map->rec_map,
+				    map->rec_map->records_count,
 				    map->hdr.record_size);
 	mail_index_map_copy_header(map, map);
 
@@ -496,6 +506,70 @@ bool mail_index_map_get_ext_idx(struct mail_index_map *map,
 	return *idx_r != (uint32_t)-1;
 }
 
+void mail_index_record_map_uids_changed(struct mail_index_record_map *rec_map)
+{
+	if (array_is_created(&rec_map->uid_samples))
+		array_clear(&rec_map->uid_samples);
+}
+
+static const uint32_t *
+mail_index_record_map_get_uid_samples(struct mail_index_record_map *rec_map,
+				      unsigned int record_size,
+				      unsigned int *count_r)
+{
+	const struct mail_index_record *rec;
+	unsigned int idx, count;
+
+	if (!array_is_created(&rec_map->uid_samples)) {
+		i_array_init(&rec_map->uid_samples,
+			     rec_map->records_count /
+			     MAIL_INDEX_UID_SAMPLE_INTERVAL + 16);
+	}
+	/* records may have been appended since the last lookup */
+	count = array_count(&rec_map->uid_samples);
+	idx = count * MAIL_INDEX_UID_SAMPLE_INTERVAL;
+	for (; idx < rec_map->records_count;
+	     idx += MAIL_INDEX_UID_SAMPLE_INTERVAL) {
+		rec = CONST_PTR_OFFSET(rec_map->records, idx * record_size);
+		array_push_back(&rec_map->uid_samples, &rec->uid);
+	}
+	return array_get(&rec_map->uid_samples, count_r);
+}
+
+static void
+mail_index_bsearch_uid_samples(struct mail_index_map *map, uint32_t uid,
+			       uint32_t *left_idx, uint32_t *right_idx)
+{
+	const uint32_t *samples;
+	unsigned int count, left, right, idx;
+
+	samples = mail_index_record_map_get_uid_samples(map->rec_map,
+		map->hdr.record_size, &count);
+	/* only the samples for records in [left_idx, right_idx) matter */
+	left = *left_idx / MAIL_INDEX_UID_SAMPLE_INTERVAL;
+	right = I_MIN(count, (*right_idx + MAIL_INDEX_UID_SAMPLE_INTERVAL - 1) /
+		      MAIL_INDEX_UID_SAMPLE_INTERVAL);
+
+	/* find the first sample with UID larger than the wanted one */
+	while (left < right) {
+		idx = (left + right) / 2;
+		if (samples[idx] <= uid)
+			left = idx+1;
+		else
+			right = idx;
+	}
+	/* Records before the previous sample have smaller UIDs, and records
+	   starting from this sample have larger UIDs. */
+	if (left > 0) {
+		idx = (left-1) * MAIL_INDEX_UID_SAMPLE_INTERVAL;
+		if (idx > *left_idx)
+			*left_idx = idx;
+	}
+	idx = left * MAIL_INDEX_UID_SAMPLE_INTERVAL;
+	if (left < count && idx > *left_idx && idx < *right_idx)
+		*right_idx = idx;
+}
+
 static uint32_t mail_index_bsearch_uid(struct mail_index_map *map,
 				       uint32_t uid, uint32_t left_idx,
 				       int nearest_side)
@@ -508,8 +582,13 @@ static uint32_t mail_index_bsearch_uid(struct mail_index_map *map,
 	rec_base = map->rec_map->records;
 	record_size = map->hdr.record_size;
 
-	idx = left_idx;
 	right_idx = I_MIN(map->hdr.messages_count, uid);
+	if (right_idx > left_idx &&
+	    right_idx - left_idx >= MAIL_INDEX_UID_SAMPLE_MIN_RECORDS) {
+		mail_index_bsearch_uid_samples(map, uid, &left_idx,
+					       &right_idx);
+	}
+	idx = left_idx;
 
 	i_assert(right_idx < INT_MAX);
 	while (left_idx < right_idx) {
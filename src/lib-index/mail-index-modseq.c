@@ -155,6 +155,50 @@ uint64_t mail_index_modseq_lookup(struct mail_index_view *view, uint32_t seq)
 	return *modseqp;
 }
 
+void mail_index_modseq_lookup_range(struct mail_index_view *view,
+				    uint32_t seq1, uint32_t seq2,
+				    uint64_t *modseqs_r)
+{
+	struct mail_index_map *map = view->map;
+	const struct mail_index_ext *ext;
+	const struct mail_index_record *rec;
+	const uint64_t *modseqp;
+	uint64_t highest_modseq = 0;
+	uint32_t seq, ext_map_idx;
+
+	i_assert(seq1 > 0 && seq1 <= seq2);
+	i_assert(seq2 <= mail_index_view_get_messages_count(view));
+
+	if (!mail_index_view_records_are_direct(view) ||
+	    !mail_index_map_get_ext_idx(map, view->index->modseq_ext_id,
+					&ext_map_idx)) {
+		/* The records may need to be looked up from other maps or
+		   the transaction, or modseqs aren't enabled. */
+		for (seq = seq1; seq <= seq2; seq++)
+			*modseqs_r++ = mail_index_modseq_lookup(view, seq);
+		return;
+	}
+
+	ext = array_idx(&map->extensions, ext_map_idx);
+	rec = MAIL_INDEX_REC_AT_SEQ(map, seq1);
+	for (seq = seq1; seq <= seq2; seq++) {
+		modseqp = CONST_PTR_OFFSET(rec, ext->record_offset);
+		if (likely(*modseqp != 0 && rec->uid != 0))
+			*modseqs_r = *modseqp;
+		else if (rec->uid == 0) {
+			/* corrupted - let the lookup handle it */
+			*modseqs_r = mail_index_modseq_lookup(view, seq);
+		} else {
+			/* see mail_index_modseq_lookup() */
+			if (highest_modseq == 0)
+				highest_modseq = mail_index_modseq_get_highest(view);
+			*modseqs_r = highest_modseq;
+		}
+		modseqs_r++;
+		rec = CONST_PTR_OFFSET(rec, map->hdr.record_size);
+	}
+}
+
 int mail_index_modseq_set(struct mail_index_view *view,
 			  uint32_t seq, uint64_t min_modseq)
 {
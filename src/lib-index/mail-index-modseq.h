@@ -29,6 +29,13 @@ bool mail_index_have_modseq_tracking(struct mail_index *index);
 uint64_t mail_index_modseq_get_highest(struct mail_index_view *view);
 
 uint64_t mail_index_modseq_lookup(struct mail_index_view *view, uint32_t seq);
+/* Look up modseqs for messages seq1..seq2 into modseqs_r[0..seq2-seq1].
+   This returns the same values as calling mail_index_modseq_lookup() for
+   each message, but when the view is up-to-date only the modseq fields of
+   the records are read. */
+void mail_index_modseq_lookup_range(struct mail_index_view *view,
+				    uint32_t seq1, uint32_t seq2,
+				    uint64_t *modseqs_r);
 int mail_index_modseq_set(struct mail_index_view *view,
 			  uint32_t seq, uint64_t min_modseq);
 void mail_index_modseq_update_to_highest(struct mail_index_modseq_sync *ctx,
@@ -22,7 +22,11 @@ struct mail_index_sync_map_ctx;
 /* Large extension header sizes are probably caused by file corruption, so
    try to catch them by limiting the header size. */
 #define MAIL_INDEX_EXT_HEADER_MAX_SIZE (1024*1024*16-1)
-
+/* UID lookups in maps with at least this many messages binary search
+   a dense array of sampled UIDs first, so that only the last few steps
+   need to touch the (much larger) records themselves. */
+#define MAIL_INDEX_UID_SAMPLE_MIN_RECORDS 1024
+#define MAIL_INDEX_UID_SAMPLE_INTERVAL 64
 #define MAIL_INDEX_IS_IN_MEMORY(index) \
 	((index)->dir == NULL)
 
@@ -133,6 +137,10 @@ struct mail_index_record_map {
 	unsigned int records_count;
 
 	uint32_t last_appended_uid;
+	/* UID of every MAIL_INDEX_UID_SAMPLE_INTERVAL'th record. Built lazily
+	   by UID lookups in large maps and cleared whenever records are
+	   removed or reordered. */
+	ARRAY(uint32_t) uid_samples;
 };
 
 #define MAIL_INDEX_MAP_HDR_OFFSET(map, hdr_offset) \
@@ -369,6 +377,9 @@ struct mail_index_map *mail_index_map_clone(const struct mail_index_map *map);
 void mail_index_record_map_move_to_private(struct mail_index_map *map);
 /* If map points to mmap()ed index, copy it to the memory. */
 void mail_index_map_move_to_memory(struct mail_index_map *map);
+/* Records were expunged or otherwise moved in rec_map. Appending new records
+   to the end doesn't require calling this. */
+void mail_index_record_map_uids_changed(struct mail_index_record_map *rec_map);
 
 void mail_index_fchown(struct mail_index *index, int fd, const char *path);
 
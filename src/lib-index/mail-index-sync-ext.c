@@ -242,7 +242,7 @@ sync_ext_resize(const struct mail_transaction_ext_intro *u,
 	struct mail_index_ext *ext;
 	struct mail_index_ext_header *ext_hdr;
 	uint32_t old_padded_hdr_size, new_padded_hdr_size, old_record_size;
-	bool reorder = FALSE;
+	bool reorder;
 
 	ext = array_idx_modifiable(&ctx->view->map->extensions, ext_map_idx);
 	old_padded_hdr_size = MAIL_INDEX_HEADER_SIZE_ALIGN(ext->hdr_size);
@@ -259,9 +259,18 @@ sync_ext_resize(const struct mail_transaction_ext_intro *u,
 		/* no changes */
 		return;
 	}
+	reorder = ext->record_align < u->record_align ||
+		(ext->record_align > u->record_align && !no_shrink) ||
+		ext->record_size < u->record_size ||
+		(ext->record_size > u->record_size && !no_shrink);
+
 	/* something changed. get ourself a new map before we start changing
-	   anything in it. */
-	map = mail_index_sync_get_atomic_map(ctx);
+	   anything in it. If only the header changes, the records can still
+	   be shared with other maps. */
+	if (reorder)
+		map = mail_index_sync_get_atomic_map(ctx);
+	else
+		map = mail_index_sync_move_to_private_memory(ctx);
 	/* ext was duplicated to the new map. */
 	ext = array_idx_modifiable(&map->extensions, ext_map_idx);
 
@@ -290,17 +299,13 @@ sync_ext_resize(const struct mail_transaction_ext_intro *u,
 	}
 
 	if (ext->record_align < u->record_align ||
-	    (ext->record_align > u->record_align && !no_shrink)) {
+	    (ext->record_align > u->record_align && !no_shrink))
 		ext->record_align = u->record_align;
-		reorder = TRUE;
-	}
 
 	old_record_size = ext->record_size;
 	if (ext->record_size < u->record_size ||
-	    (ext->record_size > u->record_size && !no_shrink)) {
+	    (ext->record_size > u->record_size && !no_shrink))
 		ext->record_size = u->record_size;
-		reorder = TRUE;
-	}
 
 	i_assert((map->hdr_copy_buf->used % sizeof(uint64_t)) == 0);
 	map->hdr.header_size = map->hdr_copy_buf->used;
@@ -125,8 +125,11 @@ keywords_header_add(struct mail_index_sync_map_ctx *ctx,
 
 	/* if we crash in the middle of writing the header, the
 	   keywords are more or less corrupted. avoid that by
-	   making sure the header is updated atomically. */
-	map = mail_index_sync_get_atomic_map(ctx);
+	   making sure the header is updated atomically. Only the header
+	   changes here, so the records can stay shared with other maps.
+	   If the record size needs to grow, keywords_ext_register() gets
+	   an atomic map for that. */
+	map = mail_index_sync_move_to_private_memory(ctx);
 
 	if (!mail_index_map_lookup_ext(map, MAIL_INDEX_EXT_KEYWORDS,
 				       &ext_map_idx))
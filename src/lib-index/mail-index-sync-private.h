@@ -62,6 +62,13 @@ int mail_index_sync_record(struct mail_index_sync_map_ctx *ctx,
 			   const struct mail_transaction_header *hdr,
 			   const void *data);
 
+/* Make sure the view has a private map with its records in memory. The
+   rec_map may still be shared with other maps, so this is enough only
+   when changing the map's headers. */
+struct mail_index_map *
+mail_index_sync_move_to_private_memory(struct mail_index_sync_map_ctx *ctx);
+/* Make sure the view has a private map whose rec_map is private as well,
+   so the records can be rewritten without affecting other maps. */
 struct mail_index_map *
 mail_index_sync_get_atomic_map(struct mail_index_sync_map_ctx *ctx);
 
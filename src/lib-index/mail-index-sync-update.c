@@ -68,7 +68,7 @@ static void mail_index_sync_replace_map(struct mail_index_sync_map_ctx *ctx,
 		view->index->map = map;
 }
 
-static struct mail_index_map *
+struct mail_index_map *
 mail_index_sync_move_to_private_memory(struct mail_index_sync_map_ctx *ctx)
 {
 	struct mail_index_map *map = ctx->view->map;
@@ -295,6 +295,7 @@ sync_expunge_range(struct mail_index_sync_map_ctx *ctx, const ARRAY_TYPE(seq_ran
 			MAIL_INDEX_REC_AT_SEQ(map, prev_seq2+1),
 			final_move_count * map->hdr.record_size);
 	}
+	mail_index_record_map_uids_changed(map->rec_map);
 }
 
 static void *sync_append_record(struct mail_index_map *map)
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "str.h"
 #include "mail-index-view-private.h"
 #include "mail-index-sync-private.h"
 #include "mail-index-transaction-private.h"
@@ -837,8 +838,39 @@ mail_index_sync_update_mailbox_offset(struct mail_index_sync_ctx *ctx)
 	}
 }
 
+static uoff_t
+mail_index_sync_rewrite_log_bytes(struct mail_index *index,
+				  uoff_t rewrite_log_bytes)
+{
+	const struct mail_index_header *hdr = &index->map->hdr;
+	uoff_t index_size = hdr->header_size +
+		(uoff_t)hdr->messages_count * hdr->record_size;
+
+	return I_MAX(rewrite_log_bytes, index_size *
+		index->optimization_set.index.rewrite_log_index_size_percentage / 100);
+}
+
+static const char *
+mail_index_sync_rewrite_reason(struct mail_index *index, const char *set_name,
+			       uoff_t set_value, uoff_t log_bytes)
+{
+	string_t *str = t_str_new(128);
+
+	str_printfa(str, ".log read %u..%u > %s %"PRIuUOFF_T,
+		    index->map->hdr.log_file_tail_offset,
+		    index->main_index_hdr_log_file_tail_offset,
+		    set_name, set_value);
+	if (log_bytes != set_value) {
+		str_printfa(str, " (raised to %"PRIuUOFF_T" by "
+			    "rewrite_log_index_size_percentage=%u)", log_bytes,
+			    index->optimization_set.index.rewrite_log_index_size_percentage);
+	}
+	return str_c(str);
+}
+
 static bool mail_index_sync_want_index_write(struct mail_index *index, const char **reason_r)
 {
+	uoff_t max_log_bytes, min_log_bytes;
 	uint32_t log_diff;
 
 	if (index->main_index_hdr_log_file_seq != 0 &&
@@ -852,21 +884,22 @@ static bool mail_index_sync_want_index_write(struct mail_index *index, const cha
 
 	log_diff = index->map->hdr.log_file_tail_offset -
 		index->main_index_hdr_log_file_tail_offset;
-	if (log_diff > index->optimization_set.index.rewrite_max_log_bytes) {
-		*reason_r = t_strdup_printf(
-			".log read %u..%u > rewrite_max_log_bytes %"PRIuUOFF_T,
-			index->map->hdr.log_file_tail_offset,
-			index->main_index_hdr_log_file_tail_offset,
-			index->optimization_set.index.rewrite_max_log_bytes);
+	max_log_bytes = mail_index_sync_rewrite_log_bytes(index,
+		index->optimization_set.index.rewrite_max_log_bytes);
+	if (log_diff > max_log_bytes) {
+		*reason_r = mail_index_sync_rewrite_reason(index,
+			"rewrite_max_log_bytes",
+			index->optimization_set.index.rewrite_max_log_bytes,
+			max_log_bytes);
 		return TRUE;
 	}
-	if (index->index_min_write &&
-	    log_diff > index->optimization_set.index.rewrite_min_log_bytes) {
-		*reason_r = t_strdup_printf(
-			".log read %u..%u > rewrite_min_log_bytes %"PRIuUOFF_T,
-			index->map->hdr.log_file_tail_offset,
-			index->main_index_hdr_log_file_tail_offset,
-			index->optimization_set.index.rewrite_min_log_bytes);
+	min_log_bytes = mail_index_sync_rewrite_log_bytes(index,
+		index->optimization_set.index.rewrite_min_log_bytes);
+	if (index->index_min_write && log_diff > min_log_bytes) {
+		*reason_r = mail_index_sync_rewrite_reason(index,
+			"rewrite_min_log_bytes",
+			index->optimization_set.index.rewrite_min_log_bytes,
+			min_log_bytes);
 		return TRUE;
 	}
 
@@ -530,4 +530,6 @@ void mail_index_transaction_export(struct mail_index_transaction *t,
 	append_ctx->want_fsync =
 		(t->view->index->set.fsync_mask & change_mask) != 0 ||
 		(t->flags & MAIL_INDEX_TRANSACTION_FLAG_FSYNC) != 0;
+	append_ctx->want_fsync_now =
+		(t->flags & MAIL_INDEX_TRANSACTION_FLAG_FSYNC) != 0;
 }
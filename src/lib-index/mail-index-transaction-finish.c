@@ -144,7 +144,8 @@ mail_index_transaction_finish_flag_updates(struct mail_index_transaction *t)
 static void
 mail_index_transaction_check_conflicts(struct mail_index_transaction *t)
 {
-	uint32_t seq;
+	uint64_t modseqs[256];
+	uint32_t seq, i, count;
 	bool ret1, ret2;
 
 	i_assert(t->max_modseq != 0);
@@ -159,13 +160,20 @@ mail_index_transaction_check_conflicts(struct mail_index_transaction *t)
 		return;
 	}
 
-	for (seq = t->min_flagupdate_seq; seq <= t->max_flagupdate_seq; seq++) {
-		if (mail_index_modseq_lookup(t->view, seq) > t->max_modseq) {
-			ret1 = mail_index_cancel_flag_updates(t, seq);
-			ret2 = mail_index_cancel_keyword_updates(t, seq);
+	for (seq = t->min_flagupdate_seq; seq <= t->max_flagupdate_seq;
+	     seq += count) {
+		count = I_MIN(N_ELEMENTS(modseqs),
+			      t->max_flagupdate_seq - seq + 1);
+		mail_index_modseq_lookup_range(t->view, seq, seq + count - 1,
+					       modseqs);
+		for (i = 0; i < count; i++) {
+			if (modseqs[i] <= t->max_modseq)
+				continue;
+			ret1 = mail_index_cancel_flag_updates(t, seq + i);
+			ret2 = mail_index_cancel_keyword_updates(t, seq + i);
 			if (ret1 || ret2) {
 				seq_range_array_add_with_init(t->conflict_seqs,
-							      16, seq);
+							      16, seq + i);
 			}
 		}
 	}
@@ -109,6 +109,10 @@ mail_index_view_dup_private(const struct mail_index_view *src,
 #define mail_index_view_dup_private(src) \
 	mail_index_view_dup_private(src, __FILE__, __LINE__)
 void mail_index_view_ref(struct mail_index_view *view);
+/* Returns TRUE if looking up records from the view returns them directly
+   from view->map, i.e. it's not a transaction view and the view's map is
+   the latest index map. */
+bool mail_index_view_records_are_direct(struct mail_index_view *view);
 void mail_index_view_unref_maps(struct mail_index_view *view);
 void mail_index_view_add_hidden_transaction(struct mail_index_view *view,
 					    uint32_t log_file_seq,
@@ -597,6 +597,12 @@ static struct mail_index_view_vfuncs view_vfuncs = {
 	view_ext_get_reset_id
 };
 
+bool mail_index_view_records_are_direct(struct mail_index_view *view)
+{
+	return view->v.lookup_full == view_lookup_full &&
+		view->map == view->index->map;
+}
+
 struct mail_index_view *
 mail_index_view_open_with_map(struct mail_index *index,
 			      struct mail_index_map *map)
@@ -37,6 +37,7 @@ static const struct mail_index_optimization_settings default_optimization_set =
 	.index = {
 		.rewrite_min_log_bytes = 8 * 1024,
 		.rewrite_max_log_bytes = 128 * 1024,
+		.rewrite_log_index_size_percentage = 6,
 	},
 	.log = {
 		.min_size = 32 * 1024,
@@ -195,6 +196,8 @@ void mail_index_set_optimization_settings(struct mail_index *index,
 		dest->index.rewrite_min_log_bytes = set->index.rewrite_min_log_bytes;
 	if (set->index.rewrite_max_log_bytes != 0)
 		dest->index.rewrite_max_log_bytes = set->index.rewrite_max_log_bytes;
+	dest->index.rewrite_log_index_size_percentage =
+		set->index.rewrite_log_index_size_percentage;
 
 	/* log */
 	if (set->log.min_size != 0)
@@ -317,6 +317,11 @@ struct mail_index_base_optimization_settings {
 	   from the .log on refresh is between these min/max values. */
 	uoff_t rewrite_min_log_bytes;
 	uoff_t rewrite_max_log_bytes;
+	/* Rewriting the index always writes the whole file, while not
+	   rewriting it only costs reading a bit more of the .log on refresh.
+	   If non-zero, the rewrite_*_log_bytes limits are raised to this
+	   percentage of the index size for large indexes. 0 disables it. */
+	unsigned int rewrite_log_index_size_percentage;
 };
 
 struct mail_index_log_optimization_settings {
@@ -380,6 +385,20 @@ void mail_index_set_cache_dir(struct mail_index *index, const char *dir);
    can be used to specify which transaction types to fsync. */
 void mail_index_set_fsync_mode(struct mail_index *index, enum fsync_mode mode,
 			       enum mail_index_fsync_mask mask);
+/* Delay the transaction log fdatasync()s done by this process until
+   mail_index_fsync_group_commit() is called. This allows committing
+   transactions to multiple indexes (e.g. delivering a mail to multiple
+   recipients) without waiting for the disk after each one of them. Each
+   log file is fdatasync()ed only once, no matter how many transactions
+   were written to it. The transactions must not be considered durable
+   until the group has been committed. Transactions committed with
+   MAIL_INDEX_TRANSACTION_FLAG_FSYNC are still fdatasync()ed immediately,
+   since their callers may depend on the write ordering. */
+void mail_index_fsync_group_begin(void);
+/* fdatasync() all the transaction logs written since
+   mail_index_fsync_group_begin(). Returns 0 if ok, -1 if any of them failed
+   (the error is logged). */
+int mail_index_fsync_group_commit(void);
 /* Try to set the index's permissions based on its index directory. Returns
    TRUE if successful (directory existed), FALSE if mail_index_set_permissions()
    should be called. */
@@ -575,6 +594,17 @@ int mail_index_fsck(struct mail_index *index) ATTR_COLD;
    mail_index_reset_fscked() call. */
 bool mail_index_reset_fscked(struct mail_index *index);
 
+/* Verify the index's records incrementally without locking the index. The
+   records are checked as they were when the verification was started.
+   mail_index_fsck() is run only if a problem is found. */
+struct mail_index_verify_ctx *mail_index_verify_init(struct mail_index *index);
+/* Verify up to max_records more records. Returns 1 if the verification is
+   finished, 0 if there are more records left, -1 if fsck failed. Use
+   mail_index_reset_fscked() to find out whether fsck was done. */
+int mail_index_verify_more(struct mail_index_verify_ctx *ctx,
+			   unsigned int max_records);
+void mail_index_verify_deinit(struct mail_index_verify_ctx **ctx);
+
 /* Synchronize changes in view. You have to go through all records, or view
    will be marked inconsistent. Only sync_mask type records are
    synchronized. */
@@ -6,6 +6,17 @@
 #include "mail-index-private.h"
 #include "mail-transaction-log-private.h"
 
+struct log_fsync_group_file {
+	struct event *event;
+	char *filepath;
+	int fd;
+	dev_t st_dev;
+	ino_t st_ino;
+};
+
+static bool log_fsync_group_active = FALSE;
+static ARRAY(struct log_fsync_group_file) log_fsync_group;
+
 void mail_transaction_log_append_add(struct mail_transaction_log_append_ctx *ctx,
 				     enum mail_transaction_type type,
 				     const void *data, size_t size)
@@ -59,6 +70,35 @@ log_buffer_move_to_memory(struct mail_transaction_log_append_ctx *ctx)
 	return 0;
 }
 
+static bool log_fsync_group_add(struct mail_transaction_log_file *file)
+{
+	struct log_fsync_group_file *gfile;
+	int fd;
+
+	array_foreach_modifiable(&log_fsync_group, gfile) {
+		if (gfile->st_ino == file->st_ino &&
+		    CMP_DEV_T(gfile->st_dev, file->st_dev))
+			return TRUE;
+	}
+
+	/* the log file may be closed before the group is committed, so
+	   keep our own fd for it. */
+	fd = dup(file->fd);
+	if (fd == -1) {
+		e_error(file->log->index->event, "dup(%s) failed: %m",
+			file->filepath);
+		return FALSE;
+	}
+	gfile = array_append_space(&log_fsync_group);
+	gfile->event = file->log->index->event;
+	event_ref(gfile->event);
+	gfile->filepath = i_strdup(file->filepath);
+	gfile->fd = fd;
+	gfile->st_dev = file->st_dev;
+	gfile->st_ino = file->st_ino;
+	return TRUE;
+}
+
 static int log_buffer_write(struct mail_transaction_log_append_ctx *ctx)
 {
 	struct mail_transaction_log_file *file = ctx->log->head;
@@ -87,7 +127,11 @@ static int log_buffer_write(struct mail_transaction_log_append_ctx *ctx)
 	if ((ctx->want_fsync &&
 	     file->log->index->set.fsync_mode != FSYNC_MODE_NEVER) ||
 	    file->log->index->set.fsync_mode == FSYNC_MODE_ALWAYS) {
-		if (fdatasync(file->fd) < 0) {
+		if (log_fsync_group_active && !ctx->want_fsync_now &&
+		    log_fsync_group_add(file)) {
+			/* fdatasync() later in
+			   mail_index_fsync_group_commit() */
+		} else if (fdatasync(file->fd) < 0) {
 			mail_index_file_set_syscall_error(ctx->log->index,
 							  file->filepath,
 							  "fdatasync()");
@@ -252,3 +296,33 @@ int mail_transaction_log_append_commit(struct mail_transaction_log_append_ctx **
 	i_free(ctx);
 	return ret;
 }
+
+void mail_index_fsync_group_begin(void)
+{
+	i_assert(!log_fsync_group_active);
+
+	i_array_init(&log_fsync_group, 8);
+	log_fsync_group_active = TRUE;
+}
+
+int mail_index_fsync_group_commit(void)
+{
+	struct log_fsync_group_file *gfile;
+	int ret = 0;
+
+	i_assert(log_fsync_group_active);
+
+	log_fsync_group_active = FALSE;
+	array_foreach_modifiable(&log_fsync_group, gfile) {
+		if (fdatasync(gfile->fd) < 0) {
+			e_error(gfile->event, "fdatasync(%s) failed: %m",
+				gfile->filepath);
+			ret = -1;
+		}
+		i_close_fd(&gfile->fd);
+		event_unref(&gfile->event);
+		i_free(gfile->filepath);
+	}
+	array_free(&log_fsync_group);
+	return ret;
+}
@@ -369,6 +369,10 @@ struct mail_transaction_log_append_ctx {
 	bool sync_includes_this:1;
 	/* fdatasync() after writing the transaction. */
 	bool want_fsync:1;
+	/* The fdatasync() was explicitly requested for this transaction, so
+	   the caller may rely on it being on disk before it writes anything
+	   else. Don't delay it with mail_index_fsync_group_begin(). */
+	bool want_fsync_now:1;
 };
 
 #define LOG_IS_BEFORE(seq1, offset1, seq2, offset2) \
@@ -216,6 +216,54 @@ static void test_mail_cache_purge_while_cache_locked(void)
 	test_end();
 }
 
+static void test_mail_cache_lock_during_purge(void)
+{
+	struct test_mail_cache_ctx ctx, ctx2;
+	const char *temp_path;
+	time_t start;
+	int fd, status;
+
+	test_begin("mail cache lock during purge");
+	test_mail_cache_init(test_mail_index_init(TRUE), &ctx);
+	test_mail_cache_add_mail(&ctx, ctx.cache_field.idx, "foo1");
+
+	/* pretend to be purging: the cache is locked and the temp file
+	   is being written */
+	test_assert(mail_cache_lock(ctx.cache) == 1);
+	temp_path = t_strconcat(ctx.cache->filepath, ".tmp", NULL);
+	fd = creat(temp_path, 0600);
+	if (fd == -1)
+		i_fatal("creat(%s) failed: %m", temp_path);
+	i_close_fd(&fd);
+
+	switch (fork()) {
+	case (pid_t)-1:
+		i_fatal("fork() failed: %m");
+	case 0:
+		/* locking fails immediately instead of waiting for
+		   the purge to finish */
+		test_mail_cache_init(test_mail_index_open(FALSE), &ctx2);
+		start = time(NULL);
+		test_assert(mail_cache_lock(ctx2.cache) < 0);
+		test_assert(time(NULL) - start < MAIL_CACHE_LOCK_TIMEOUT / 2);
+		test_mail_cache_deinit(&ctx2);
+		test_mail_cache_deinit(&ctx);
+		test_exit(test_has_failed() ? 10 : 0);
+	default:
+		break;
+	}
+
+	if (wait(&status) == -1)
+		i_error("wait() failed: %m");
+	test_assert(status == 0);
+
+	mail_cache_unlock(ctx.cache);
+	i_unlink(temp_path);
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
 static bool cache_equals(struct mail_cache_view *cache_view, uint32_t seq,
 			 unsigned int field_idx, const char *value)
 {
@@ -1086,6 +1134,7 @@ int main(void)
 		test_mail_cache_read_during_purge,
 		test_mail_cache_write_during_purge,
 		test_mail_cache_purge_while_cache_locked,
+		test_mail_cache_lock_during_purge,
 		test_mail_cache_write_lost_during_purge,
 		test_mail_cache_write_lost_during_purge2,
 		test_mail_cache_write_autocommit,
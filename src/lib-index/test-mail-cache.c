@@ -806,6 +806,224 @@ static void test_mail_cache_duplicate_fields(void)
 	test_end();
 }
 
+/* Simple run-length encoding: (count, byte) pairs */
+static int
+test_cache_rle_compress(void *context ATTR_UNUSED, const void *data,
+			size_t size, buffer_t *dest,
+			const char **error_r ATTR_UNUSED)
+{
+	const unsigned char *p = data;
+	unsigned char pair[2];
+
+	for (size_t i = 0; i < size; ) {
+		pair[0] = 0;
+		pair[1] = p[i];
+		for (; i < size && p[i] == pair[1] && pair[0] < UINT8_MAX; i++)
+			pair[0]++;
+		buffer_append(dest, pair, sizeof(pair));
+	}
+	return 0;
+}
+
+static int
+test_cache_rle_decompress(void *context ATTR_UNUSED, const void *data,
+			  size_t size, buffer_t *dest, const char **error_r)
+{
+	const unsigned char *p = data;
+
+	if (size % 2 != 0) {
+		*error_r = "odd size";
+		return -1;
+	}
+	for (size_t i = 0; i < size; i += 2) {
+		for (unsigned int j = 0; j < p[i]; j++)
+			buffer_append_c(dest, p[i+1]);
+	}
+	return 0;
+}
+
+static const struct mail_cache_compression test_cache_rle = {
+	.compress = test_cache_rle_compress,
+	.decompress = test_cache_rle_decompress,
+};
+
+static bool
+test_mail_cache_field_is_compressed(struct mail_cache_view *cache_view,
+				    uint32_t seq, unsigned int field_idx)
+{
+	struct mail_cache_lookup_iterate_ctx iter;
+	struct mail_cache_iterate_field field;
+	bool compressed = FALSE;
+
+	mail_cache_lookup_iter_init(cache_view, seq, &iter);
+	while (mail_cache_lookup_iter_next(&iter, &field) > 0) {
+		if (field.field_idx == field_idx)
+			compressed = field.compressed;
+	}
+	return compressed;
+}
+
+static void test_mail_cache_compression(void)
+{
+	struct mail_cache_field header_field = {
+		.name = "hdr.subject",
+		.type = MAIL_CACHE_FIELD_HEADER,
+		.decision = MAIL_CACHE_DECISION_YES,
+	};
+	static const char hdr_value[] =
+		"Subject: xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\n";
+	struct test_mail_cache_ctx ctx;
+	struct mail_index_transaction *trans;
+	struct mail_cache_view *cache_view;
+	struct mail_cache_transaction_ctx *cache_trans;
+	string_t *str = t_str_new(128);
+	buffer_t *hdr_buf = t_buffer_create(128);
+	uint32_t line = 1, end_of_lines = 0;
+
+	test_begin("mail cache compression");
+	test_mail_cache_init(test_mail_index_init(TRUE), &ctx);
+	mail_cache_register_fields(ctx.cache, &header_field, 1,
+				   unsafe_data_stack_pool);
+	mail_cache_register_compression(ctx.cache, &test_cache_rle, NULL, 16);
+	test_mail_cache_add_mail(&ctx, UINT_MAX, NULL);
+
+	buffer_append(hdr_buf, &line, sizeof(line));
+	buffer_append(hdr_buf, &end_of_lines, sizeof(end_of_lines));
+	buffer_append(hdr_buf, hdr_value, strlen(hdr_value));
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	trans = mail_index_transaction_begin(ctx.view, 0);
+	cache_trans = mail_cache_get_transaction(cache_view, trans);
+	/* compressible, too short, not worth compressing */
+	mail_cache_add(cache_trans, 1, ctx.cache_field.idx,
+		       "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 32);
+	mail_cache_add(cache_trans, 1, ctx.cache_field2.idx, "aaaa", 4);
+	mail_cache_add(cache_trans, 1, ctx.cache_field3.idx,
+		       "abcdefghijklmnopqrstuvwxyz", 26);
+	mail_cache_add(cache_trans, 1, header_field.idx,
+		       hdr_buf->data, hdr_buf->used);
+
+	/* lookups from the uncommitted transaction */
+	test_assert(test_mail_cache_field_is_compressed(cache_view, 1, ctx.cache_field.idx));
+	test_assert(!test_mail_cache_field_is_compressed(cache_view, 1, ctx.cache_field2.idx));
+	test_assert(!test_mail_cache_field_is_compressed(cache_view, 1, ctx.cache_field3.idx));
+	test_assert(test_mail_cache_field_is_compressed(cache_view, 1, header_field.idx));
+	test_assert(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field.idx) == 1);
+	test_assert_strcmp(str_c(str), "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_mail_cache_view_sync(&ctx);
+
+	/* the compressed data is in a separate field in the cache file */
+	unsigned int compressed_idx =
+		mail_cache_register_lookup(ctx.cache, "compressed.foo");
+	test_assert(compressed_idx != UINT_MAX);
+	test_assert(mail_cache_register_lookup(ctx.cache, "compressed.bar") == UINT_MAX);
+
+	/* lookups from the cache file, before and after purging */
+	for (unsigned int i = 0; i < 2; i++) {
+		test_assert_idx(ctx.cache->field_file_map[compressed_idx] != (uint32_t)-1, i);
+		test_assert_idx(ctx.cache->field_file_map[ctx.cache_field.idx] != (uint32_t)-1, i);
+		test_assert_idx(test_mail_cache_field_is_compressed(cache_view, 1, ctx.cache_field.idx), i);
+		str_truncate(str, 0);
+		test_assert_idx(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field.idx) == 1, i);
+		test_assert_strcmp_idx(str_c(str), "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", i);
+		str_truncate(str, 0);
+		test_assert_idx(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field2.idx) == 1, i);
+		test_assert_strcmp_idx(str_c(str), "aaaa", i);
+		str_truncate(str, 0);
+		test_assert_idx(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field3.idx) == 1, i);
+		test_assert_strcmp_idx(str_c(str), "abcdefghijklmnopqrstuvwxyz", i);
+		str_truncate(str, 0);
+		test_assert_idx(mail_cache_lookup_headers(cache_view, str, 1, &header_field.idx, 1) == 1, i);
+		test_assert_strcmp_idx(str_c(str), hdr_value, i);
+
+		test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+		test_mail_cache_view_sync(&ctx);
+	}
+
+	/* the latest registration that is still registered is used */
+	int context1, context2;
+	mail_cache_register_compression(ctx.cache, &test_cache_rle, &context1, 16);
+	mail_cache_register_compression(ctx.cache, &test_cache_rle, &context2, 32);
+	test_assert(ctx.cache->compression_context == &context2);
+	mail_cache_unregister_compression(ctx.cache, &context2);
+	test_assert(ctx.cache->compression_context == &context1);
+	test_assert(ctx.cache->compression_min_size == 16);
+	mail_cache_unregister_compression(ctx.cache, &context1);
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field.idx) == 1);
+	test_assert_strcmp(str_c(str), "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+
+	/* compressed fields can't be read without decompression */
+	mail_cache_unregister_compression(ctx.cache, NULL);
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field.idx) == 0);
+	test_assert(mail_cache_lookup_headers(cache_view, str, 1, &header_field.idx, 1) == 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field2.idx) == 1);
+
+	/* they're treated as not cached, so they can be added again */
+	test_assert(mail_cache_field_exists(cache_view, 1, ctx.cache_field.idx) == 0);
+	trans = mail_index_transaction_begin(ctx.view, 0);
+	cache_trans = mail_cache_get_transaction(cache_view, trans);
+	test_assert(mail_cache_field_can_add(cache_trans, 1, ctx.cache_field.idx));
+	mail_cache_add(cache_trans, 1, ctx.cache_field.idx, "uncompressed", 12);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_mail_cache_view_sync(&ctx);
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field.idx) == 1);
+	test_assert_strcmp(str_c(str), "uncompressed");
+
+	/* purging drops the compressed copy */
+	test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+	test_mail_cache_view_sync(&ctx);
+	mail_cache_register_compression(ctx.cache, &test_cache_rle, NULL, 16);
+	test_assert(!test_mail_cache_field_is_compressed(cache_view, 1, ctx.cache_field.idx));
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1, ctx.cache_field.idx) == 1);
+	test_assert_strcmp(str_c(str), "uncompressed");
+	mail_cache_unregister_compression(ctx.cache, NULL);
+
+	mail_cache_view_close(&cache_view);
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
+static void test_mail_cache_prefetch(void)
+{
+	struct test_mail_cache_ctx ctx;
+	struct mail_cache_view *cache_view;
+	string_t *str = t_str_new(16);
+	uint32_t seq;
+
+	test_begin("mail cache prefetch");
+	test_mail_cache_init(test_mail_index_init(TRUE), &ctx);
+	for (seq = 1; seq <= 5; seq++)
+		test_mail_cache_add_mail(&ctx, UINT_MAX, NULL);
+	/* add the records in reverse order, so the cache offsets are
+	   descending */
+	for (seq = 5; seq >= 1; seq--) {
+		test_mail_cache_add_field(&ctx, seq, ctx.cache_field.idx,
+					  t_strdup_printf("foo%u", seq));
+	}
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	/* seq2 may point past the existing messages */
+	mail_cache_prefetch(cache_view, 2, 100);
+	mail_cache_prefetch(cache_view, 6, 100);
+	for (seq = 1; seq <= 5; seq++) {
+		str_truncate(str, 0);
+		test_assert_idx(mail_cache_lookup_field(cache_view, str, seq,
+							ctx.cache_field.idx) == 1, seq);
+		test_assert_strcmp_idx(str_c(str), t_strdup_printf("foo%u", seq), seq);
+	}
+
+	mail_cache_view_close(&cache_view);
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
@@ -820,6 +1038,8 @@ int main(void)
 		test_mail_cache_in_memory,
 		test_mail_cache_size_corruption,
 		test_mail_cache_duplicate_fields,
+		test_mail_cache_compression,
+		test_mail_cache_prefetch,
 		NULL
 	};
 	return test_run(test_functions);
@@ -37,6 +37,74 @@ static void test_mail_index_map_lookup_seq_range_count(unsigned int messages_cou
 	i_free(rec_map.records);
 }
 
+static void
+test_mail_index_map_lookup_seq_range_check(struct mail_index_map *map,
+					   uint32_t first_uid,
+					   uint32_t last_uid)
+{
+	uint32_t seq, first_seq, last_seq, exp_first_seq = 0, exp_last_seq = 0;
+
+	for (seq = 1; seq <= map->hdr.messages_count; seq++) {
+		uint32_t uid = MAIL_INDEX_REC_AT_SEQ(map, seq)->uid;
+		if (uid >= first_uid && uid <= last_uid) {
+			if (exp_first_seq == 0)
+				exp_first_seq = seq;
+			exp_last_seq = seq;
+		}
+	}
+	mail_index_map_lookup_seq_range(map, first_uid, last_uid,
+					&first_seq, &last_seq);
+	test_assert_idx(first_seq == exp_first_seq &&
+			last_seq == exp_last_seq, first_uid);
+}
+
+static void test_mail_index_map_lookup_seq_range_large(void)
+{
+	struct mail_index_record_map rec_map;
+	struct mail_index_map map;
+	uint32_t seq, uid, first_uid, max_uid;
+	unsigned int i, count = MAIL_INDEX_UID_SAMPLE_MIN_RECORDS * 4 + 17;
+
+	test_begin("mail index map lookup seq range large");
+	i_zero(&map);
+	i_zero(&rec_map);
+	map.rec_map = &rec_map;
+	map.hdr.messages_count = count;
+	map.hdr.record_size = sizeof(struct mail_index_record);
+	rec_map.records_count = count;
+	rec_map.records = i_new(struct mail_index_record, count);
+
+	for (seq = 1, uid = 1; seq <= count; seq++) {
+		uid += i_rand_minmax(1, 3);
+		MAIL_INDEX_REC_AT_SEQ(&map, seq)->uid = uid;
+	}
+	max_uid = uid;
+	map.hdr.next_uid = max_uid + 1;
+
+	for (uid = 1; uid <= max_uid + 1; uid++)
+		test_mail_index_map_lookup_seq_range_check(&map, uid, uid);
+	for (i = 0; i < 1000; i++) {
+		first_uid = i_rand_minmax(1, max_uid);
+		test_mail_index_map_lookup_seq_range_check(&map, first_uid,
+			first_uid + i_rand_limit(max_uid));
+	}
+
+	/* expunge the first half of the records */
+	memmove(rec_map.records, MAIL_INDEX_REC_AT_SEQ(&map, count/2 + 1),
+		(count - count/2) * sizeof(struct mail_index_record));
+	map.hdr.messages_count = rec_map.records_count = count - count/2;
+	mail_index_record_map_uids_changed(&rec_map);
+	for (i = 0; i < 1000; i++) {
+		first_uid = i_rand_minmax(1, max_uid);
+		test_mail_index_map_lookup_seq_range_check(&map, first_uid,
+			first_uid + i_rand_limit(max_uid));
+	}
+
+	array_free(&rec_map.uid_samples);
+	i_free(rec_map.records);
+	test_end();
+}
+
 static void test_mail_index_map_lookup_seq_range(void)
 {
 	unsigned int i;
@@ -51,6 +119,7 @@ int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mail_index_map_lookup_seq_range,
+		test_mail_index_map_lookup_seq_range_large,
 		NULL
 	};
 	return test_run(test_functions);
@@ -67,10 +67,68 @@ static void test_mail_index_modseq_get_next_log_offset(void)
 	test_end();
 }
 
+static void
+test_mail_index_modseq_lookup_range_check(struct mail_index_view *view,
+					  uint32_t seq1, uint32_t seq2)
+{
+	uint64_t modseqs[10];
+	uint32_t seq;
+
+	i_assert(seq2 - seq1 < N_ELEMENTS(modseqs));
+	mail_index_modseq_lookup_range(view, seq1, seq2, modseqs);
+	for (seq = seq1; seq <= seq2; seq++) {
+		test_assert_idx(modseqs[seq - seq1] ==
+				mail_index_modseq_lookup(view, seq), seq);
+	}
+}
+
+static void test_mail_index_modseq_lookup_range(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view, *view2;
+	struct mail_index_transaction *trans;
+	uint32_t seq, uid;
+
+	test_begin("mail_index_modseq_lookup_range()");
+	index = test_mail_index_init(TRUE);
+	view = mail_index_view_open(index);
+	mail_index_modseq_enable(index);
+
+	trans = mail_index_transaction_begin(view, 0);
+	uid = 1234;
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid, sizeof(uid), TRUE);
+	for (uid = 1; uid <= 10; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+
+	view2 = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view2, 0);
+	mail_index_update_flags(trans, 3, MODIFY_ADD, MAIL_SEEN);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_assert(mail_index_modseq_lookup(view2, 3) >
+		    mail_index_modseq_lookup(view2, 4));
+
+	/* view2 map is older than the index map */
+	test_mail_index_modseq_lookup_range_check(view2, 1, 10);
+	mail_index_view_close(&view2);
+	/* view2 map is the latest index map */
+	view2 = mail_index_view_open(index);
+	test_mail_index_modseq_lookup_range_check(view2, 1, 10);
+	test_mail_index_modseq_lookup_range_check(view2, 3, 4);
+
+	mail_index_view_close(&view);
+	mail_index_view_close(&view2);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mail_index_modseq_get_next_log_offset,
+		test_mail_index_modseq_lookup_range,
 		NULL
 	};
 	return test_run(test_functions);
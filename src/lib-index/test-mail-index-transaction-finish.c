@@ -44,11 +44,12 @@ mail_index_transaction_lookup(struct mail_index_transaction *t ATTR_UNUSED,
 	return &recs[seq];
 }
 
-uint64_t mail_index_modseq_lookup(struct mail_index_view *view ATTR_UNUSED,
-				  uint32_t seq)
+void mail_index_modseq_lookup_range(struct mail_index_view *view ATTR_UNUSED,
+				    uint32_t seq1, uint32_t seq2,
+				    uint64_t *modseqs_r)
 {
-	i_assert(seq < N_ELEMENTS(modseqs));
-	return modseqs[seq];
+	i_assert(seq2 < N_ELEMENTS(modseqs));
+	memcpy(modseqs_r, &modseqs[seq1], (seq2 - seq1 + 1) * sizeof(uint64_t));
 }
 
 uint64_t mail_index_modseq_get_highest(struct mail_index_view *view ATTR_UNUSED)
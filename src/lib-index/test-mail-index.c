@@ -158,11 +158,287 @@ static void test_mail_index_new_extension(void)
 	test_end();
 }
 
+static void test_mail_index_sync(struct mail_index *index)
+{
+	struct mail_index_sync_ctx *sync_ctx;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	struct mail_index_sync_rec sync_rec;
+
+	test_assert(mail_index_sync_begin(index, &sync_ctx, &view,
+					  &trans, 0) == 1);
+	while (mail_index_sync_next(sync_ctx, &sync_rec)) ;
+	test_assert(mail_index_sync_commit(&sync_ctx) == 0);
+}
+
+static void
+test_mail_index_add_keyword(struct mail_index_transaction *trans,
+			    uint32_t seq, const char *name)
+{
+	struct mail_keywords *keywords;
+	const char *const names[] = { name, NULL };
+
+	keywords = mail_index_keywords_create(trans->view->index, names);
+	mail_index_update_keywords(trans, seq, MODIFY_ADD, keywords);
+	mail_index_keywords_unref(&keywords);
+}
+
+static void test_mail_index_keyword_add_shares_records(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view, *view2;
+	struct mail_index_view_sync_ctx *sync_ctx;
+	struct mail_index_view_sync_rec sync_rec;
+	struct mail_index_transaction *trans;
+	ARRAY_TYPE(keyword_indexes) keyword_idx;
+	uint32_t seq, uid_validity = 123456;
+	bool delayed_expunges;
+
+	test_begin("mail index keyword add shares records");
+	index = test_mail_index_init(TRUE);
+	view = mail_index_view_open(index);
+
+	trans = mail_index_transaction_begin(view, 0);
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid_validity, sizeof(uid_validity), TRUE);
+	for (unsigned int uid = 1; uid <= 3; uid++)
+		mail_index_append(trans, uid, &seq);
+	/* the first keyword creates the keywords extension */
+	test_mail_index_add_keyword(trans, 1, "foo");
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_mail_index_sync(index);
+	mail_index_view_close(&view);
+
+	/* both views point to the same map */
+	view = mail_index_view_open(index);
+	view2 = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view, 0);
+	test_mail_index_add_keyword(trans, 2, "bar");
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+
+	test_assert(mail_index_refresh(index) == 0);
+	sync_ctx = mail_index_view_sync_begin(view2, 0);
+	while (mail_index_view_sync_next(sync_ctx, &sync_rec)) ;
+	test_assert(mail_index_view_sync_commit(&sync_ctx, &delayed_expunges) == 0);
+
+	/* adding the keyword changed only the map header, so the records
+	   are still shared with the old map */
+	test_assert(view->map != view2->map);
+	test_assert(view->map->rec_map == view2->map->rec_map);
+
+	t_array_init(&keyword_idx, 2);
+	mail_index_lookup_keywords(view2, 1, &keyword_idx);
+	test_assert(array_count(&keyword_idx) == 1);
+	mail_index_lookup_keywords(view2, 2, &keyword_idx);
+	test_assert(array_count(&keyword_idx) == 1);
+	mail_index_lookup_keywords(view2, 3, &keyword_idx);
+	test_assert(array_count(&keyword_idx) == 0);
+
+	mail_index_view_close(&view);
+	mail_index_view_close(&view2);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_verify(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	struct mail_index_verify_ctx *ctx;
+	struct mail_index_record *rec;
+	uint32_t seq, uid_validity = 123456;
+	unsigned int i;
+	int ret;
+
+	test_begin("mail index verify");
+	index = test_mail_index_init(TRUE);
+	view = mail_index_view_open(index);
+
+	trans = mail_index_transaction_begin(view, 0);
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid_validity, sizeof(uid_validity), TRUE);
+	for (unsigned int uid = 1; uid <= 10; uid++) {
+		mail_index_append(trans, uid, &seq);
+		if (uid % 3 == 0)
+			mail_index_update_flags(trans, seq, MODIFY_ADD, MAIL_SEEN);
+	}
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_mail_index_sync(index);
+	mail_index_view_close(&view);
+
+	/* valid index: 3 records at a time */
+	ctx = mail_index_verify_init(index);
+	for (i = 0; (ret = mail_index_verify_more(ctx, 3)) == 0; i++) ;
+	test_assert(ret == 1 && i == 3);
+	test_assert(mail_index_verify_more(ctx, 3) == 1);
+	mail_index_verify_deinit(&ctx);
+	test_assert(!mail_index_reset_fscked(index));
+
+	/* broken UID order is found and fixed */
+	rec = MAIL_INDEX_REC_AT_SEQ(index->map, 5);
+	rec->uid = 3;
+	ctx = mail_index_verify_init(index);
+	test_assert(mail_index_verify_more(ctx, 3) == 0);
+	/* the error, fsck warning and two fixes */
+	test_expect_errors(4);
+	test_assert(mail_index_verify_more(ctx, 3) == 1);
+	test_expect_no_more_errors();
+	mail_index_verify_deinit(&ctx);
+	test_assert(mail_index_reset_fscked(index));
+	test_assert(index->map->hdr.messages_count == 9);
+
+	/* broken counters are found and fixed */
+	index->map->hdr.seen_messages_count++;
+	ctx = mail_index_verify_init(index);
+	test_expect_errors(3);
+	test_assert(mail_index_verify_more(ctx, 100) == 1);
+	test_expect_no_more_errors();
+	mail_index_verify_deinit(&ctx);
+	test_assert(mail_index_reset_fscked(index));
+	test_assert(index->map->hdr.seen_messages_count == 3);
+
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_append_recreate(struct mail_index *index,
+					     uint32_t first_uid,
+					     uint32_t last_uid)
+{
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint32_t seq, uid_validity = 123456;
+
+	/* make sure we have the latest index file open, or it won't be
+	   recreated */
+	test_assert(mail_index_refresh(index) == 0);
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view, 0);
+	if (first_uid == 1) {
+		mail_index_update_header(trans,
+			offsetof(struct mail_index_header, uid_validity),
+			&uid_validity, sizeof(uid_validity), TRUE);
+	}
+	for (uint32_t uid = first_uid; uid <= last_uid; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	index->need_recreate = i_strdup("test");
+	test_mail_index_sync(index);
+}
+
+static void test_mail_index_mmap_reopen(void)
+{
+	struct mail_index *index, *index2;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint32_t seq, count = MAIL_INDEX_MMAP_MIN_SIZE /
+		sizeof(struct mail_index_record) + 1;
+
+	test_begin("mail index mmap reopen");
+	index = test_mail_index_init(TRUE);
+	test_mail_index_append_recreate(index, 1, count);
+
+	index2 = test_mail_index_open(FALSE);
+	test_assert(index2->map->rec_map->mmap_base != NULL);
+
+	/* appending copies the records to memory */
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view, 0);
+	mail_index_append(trans, count + 1, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+	test_mail_index_sync(index);
+	test_assert(mail_index_refresh(index2) == 0);
+	test_assert(index2->map->rec_map->mmap_base == NULL);
+	test_assert(index2->map->hdr.messages_count == count + 1);
+
+	/* once the index is recreated, it's mmap()ed again */
+	test_mail_index_append_recreate(index, count + 2, count + 2);
+	test_assert(mail_index_refresh(index2) == 0);
+	test_assert(index2->map->rec_map->mmap_base != NULL);
+	test_assert(index2->map->hdr.messages_count == count + 2);
+
+	test_mail_index_deinit(&index);
+	test_mail_index_deinit(&index2);
+	test_end();
+}
+
+static void test_mail_index_update_flags_range(struct mail_index *index,
+					       uint32_t seq1, uint32_t seq2)
+{
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+
+	test_assert(mail_index_refresh(index) == 0);
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view, 0);
+	/* every other message, so each one needs its own log record */
+	for (uint32_t seq = seq1; seq <= seq2; seq += 2)
+		mail_index_update_flags(trans, seq, MODIFY_ADD, MAIL_SEEN);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+	test_mail_index_sync(index);
+}
+
+static ino_t test_mail_index_get_ino(struct mail_index *index)
+{
+	struct stat st;
+
+	if (stat(index->filepath, &st) < 0)
+		i_fatal("stat(%s) failed: %m", index->filepath);
+	return st.st_ino;
+}
+
+static void test_mail_index_rewrite_index_size(void)
+{
+	struct mail_index *index;
+	uint32_t count = MAIL_INDEX_MMAP_MIN_SIZE /
+		sizeof(struct mail_index_record) + 1;
+	ino_t ino;
+
+	test_begin("mail index rewrite scales with index size");
+	index = test_mail_index_init(TRUE);
+	index->optimization_set.index.rewrite_min_log_bytes = 1024;
+	index->optimization_set.index.rewrite_max_log_bytes = 1024;
+	test_mail_index_append_recreate(index, 1, count);
+	ino = test_mail_index_get_ino(index);
+
+	/* the .log grows past rewrite_max_log_bytes, but it's still small
+	   compared to the index */
+	test_mail_index_update_flags_range(index, 1, 400);
+	test_assert(index->map->hdr.log_file_tail_offset -
+		    index->main_index_hdr_log_file_tail_offset > 1024);
+	test_assert(test_mail_index_get_ino(index) == ino);
+
+	/* large enough to rewrite */
+	test_mail_index_update_flags_range(index, 401, count);
+	test_assert(test_mail_index_get_ino(index) != ino);
+
+	/* the scaling can be disabled (the rewritten file may get the same
+	   inode again, so check that the index points to the .log tail) */
+	index->optimization_set.index.rewrite_log_index_size_percentage = 0;
+	test_mail_index_update_flags_range(index, 2, 401);
+	test_assert(index->map->hdr.log_file_tail_offset ==
+		    index->main_index_hdr_log_file_tail_offset);
+
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mail_index_rotate,
 		test_mail_index_new_extension,
+		test_mail_index_keyword_add_shares_records,
+		test_mail_index_verify,
+		test_mail_index_mmap_reopen,
+		test_mail_index_rewrite_index_size,
 		NULL
 	};
 	return test_run(test_functions);
@@ -156,6 +156,29 @@ static void test_mail_transaction_log_append(void)
 	file->fd = -1;
 	test_end();
 
+	test_begin("transaction log append: fsync group");
+	log->index->event = event_create(NULL);
+	log->index->set.fsync_mode = FSYNC_MODE_ALWAYS;
+	file->log = log;
+	file->fd = fd;
+	if (fstat(fd, &st) < 0) i_fatal("fstat() failed: %m");
+	file->st_dev = st.st_dev;
+	file->st_ino = st.st_ino;
+	mail_index_fsync_group_begin();
+	for (unsigned int i = 0; i < 2; i++) {
+		test_assert(mail_transaction_log_append_begin(log->index, 0, &ctx) == 0);
+		mail_transaction_log_append_add(ctx, MAIL_TRANSACTION_EXPUNGE,
+						&fd, sizeof(fd));
+		test_assert(mail_transaction_log_append_commit(&ctx) == 0);
+	}
+	/* the file can be closed before the group is committed */
+	file->fd = -1;
+	test_assert(mail_index_fsync_group_commit() == 0);
+	if (fstat(fd, &st) < 0) i_fatal("fstat() failed: %m");
+	test_assert(st.st_size > 1);
+	event_unref(&log->index->event);
+	test_end();
+
 	buffer_free(&log->head->buffer);
 	i_free(log->head);
 	i_free(log->index);
@@ -116,12 +116,30 @@ i_stream_dot_return(struct istream_private *stream, size_t dest, ssize_t ret)
 	return ret;
 }
 
+static size_t
+i_stream_dot_plain_len(struct dot_istream *dstream,
+		       const unsigned char *data, size_t size)
+{
+	const unsigned char *p;
+
+	/* find the next byte that could change the state */
+	p = memchr(data, '\r', size);
+	if (p != NULL)
+		size = p - data;
+	if (dstream->accept_bare_lf) {
+		p = memchr(data, '\n', size);
+		if (p != NULL)
+			size = p - data;
+	}
+	return size;
+}
+
 static ssize_t i_stream_dot_read(struct istream_private *stream)
 {
 	/* @UNSAFE */
 	struct dot_istream *dstream = (struct dot_istream *)stream;
 	const unsigned char *data;
-	size_t i, dest, size, avail;
+	size_t i, dest, size, avail, len;
 	ssize_t ret, ret1;
 
 	if (dstream->pending[0] != '\0') {
@@ -211,7 +229,13 @@ static ssize_t i_stream_dot_read(struct istream_private *stream)
 				dstream->state = DOT_STATE_SEEN_CR_LF;
 				dstream->state_no_cr = TRUE;
 			} else {
-				stream->w_buffer[dest++] = data[i];
+				/* copy everything until the next line ending */
+				len = i_stream_dot_plain_len(dstream, data + i,
+					I_MIN(size - i, stream->buffer_size - dest));
+				i_assert(len > 0);
+				memcpy(stream->w_buffer + dest, data + i, len);
+				dest += len;
+				i += len - 1;
 			}
 		}
 	}
@@ -80,8 +80,8 @@ int message_parse_header_next(struct message_header_parser_ctx *ctx,
 			      struct message_header_line **hdr_r)
 {
         struct message_header_line *line = &ctx->line;
-	const unsigned char *msg;
-	size_t i, size, startpos, colon_pos, parse_size, skip = 0;
+	const unsigned char *msg, *p;
+	size_t i, size, startpos, colon_pos, parse_size, end, skip = 0;
 	int ret;
 	bool continued, continues, last_no_newline, last_crlf;
 	bool no_newline, crlf_newline;
@@ -212,13 +212,12 @@ int message_parse_header_next(struct message_header_parser_ctx *ctx,
 		}
 
 		/* find '\n' */
-		for (; i < parse_size; i++) {
-			if (msg[i] <= '\n') {
-				if (msg[i] == '\n')
-					break;
-				if (msg[i] == '\0')
-					ctx->has_nuls = TRUE;
-			}
+		if (i < parse_size) {
+			p = memchr(msg + i, '\n', parse_size - i);
+			end = p == NULL ? parse_size : (size_t)(p - msg);
+			if (!ctx->has_nuls && memchr(msg + i, '\0', end - i) != NULL)
+				ctx->has_nuls = TRUE;
+			i = end;
 		}
 
 		if (i < parse_size && i+1 == size && ret == -2) {
@@ -194,17 +194,36 @@ void message_search_reset(struct message_search_context *ctx)
 int message_search_msg(struct message_search_context *ctx,
 		       struct istream *input, struct message_part *parts,
 		       const char **error_r)
+{
+	bool match;
+
+	if (message_search_msg_multi(&ctx, 1, input, parts, &match,
+				     error_r) < 0)
+		return -1;
+	return match ? 1 : 0;
+}
+
+int message_search_msg_multi(struct message_search_context *const *ctxs,
+			     unsigned int count, struct istream *input,
+			     struct message_part *parts, bool *matches_r,
+			     const char **error_r)
 {
 	const struct message_parser_settings parser_set = {
 		.hdr_flags = MESSAGE_HEADER_PARSER_FLAG_CLEAN_ONELINE,
 	};
 	struct message_parser_ctx *parser_ctx;
-	struct message_block raw_block;
+	struct message_block raw_block, decoded_block;
 	struct message_part *new_parts;
 	pool_t pool = NULL;
+	unsigned int i, match_count = 0;
 	int ret;
 
-	message_search_reset(ctx);
+	i_assert(count > 0);
+
+	for (i = 0; i < count; i++) {
+		message_search_reset(ctxs[i]);
+		matches_r[i] = FALSE;
+	}
 
 	if (parts != NULL) {
 		parser_ctx = message_parser_init_from_parts(parts,
@@ -216,14 +235,30 @@ int message_search_msg(struct message_search_context *ctx,
 
 	while ((ret = message_parser_parse_next_block(parser_ctx,
 						      &raw_block)) > 0) {
-		if (message_search_more(ctx, &raw_block)) {
+		/* the first context decodes the block, the rest search the
+		   already decoded data */
+		if (message_search_more_get_decoded(ctxs[0], &raw_block,
+						    &decoded_block) &&
+		    !matches_r[0]) {
+			matches_r[0] = TRUE;
+			match_count++;
+		}
+		for (i = 1; i < count; i++) {
+			if (!matches_r[i] &&
+			    message_search_more_decoded(ctxs[i],
+							&decoded_block)) {
+				matches_r[i] = TRUE;
+				match_count++;
+			}
+		}
+		if (match_count == count) {
 			ret = 1;
 			break;
 		}
 	}
 	i_assert(ret != 0);
-	if (ret < 0 && input->stream_errno == 0) {
-		/* normal exit */
+	if (ret > 0 || input->stream_errno == 0) {
+		/* all keys found or normal exit */
 		ret = 0;
 	}
 	if (message_parser_deinit_from_parts(&parser_ctx, &new_parts, error_r) < 0) {
@@ -36,5 +36,15 @@ int message_search_msg(struct message_search_context *ctx,
 		       struct istream *input, struct message_part *parts,
 		       const char **error_r)
 	ATTR_NULL(3);
+/* Search a full message for multiple keys at once. The message is parsed and
+   decoded only once. All the contexts must have been created with the same
+   normalizer and flags. matches_r[i] is set to TRUE if ctxs[i]'s key was
+   found. Returns 0 if ok, -1 if error (if stream_error == 0, the parts
+   contained broken data) */
+int message_search_msg_multi(struct message_search_context *const *ctxs,
+			     unsigned int count, struct istream *input,
+			     struct message_part *parts, bool *matches_r,
+			     const char **error_r)
+	ATTR_NULL(4);
 
 #endif
@@ -71,6 +71,17 @@ o_stream_dot_close(struct iostream_private *stream, bool close_parent)
 		o_stream_close(dstream->ostream.parent);
 }
 
+static const char *o_stream_dot_find_eol(const char *p, const char *end)
+{
+	const char *eol;
+
+	eol = memchr(p, '\r', end - p);
+	if (eol != NULL)
+		end = eol;
+	eol = memchr(p, '\n', end - p);
+	return eol != NULL ? eol : end;
+}
+
 static ssize_t
 o_stream_dot_sendv(struct ostream_private *stream,
 		    const struct const_iovec *iov, unsigned int iov_count)
@@ -120,6 +131,16 @@ o_stream_dot_sendv(struct ostream_private *stream,
 				case '\r':
 					dstream->state = STREAM_STATE_CR;
 					break;
+				default:
+					/* skip to the next line ending at once.
+					   max_bytes may be SIZE_MAX, so limit
+					   the length instead of the pointer. */
+					p++;
+					p = o_stream_dot_find_eol(p, p +
+						I_MIN((size_t)(pend - p),
+						      max_bytes - 2 -
+						      (size_t)(p - data))) - 1;
+					break;
 				}
 				break;
 			/* got CR */
@@ -510,11 +510,61 @@ static void test_message_search_more_get_decoded(void)
 	test_end();
 }
 
+static void test_message_search_msg_multi(void)
+{
+	const char input[] =
+		"Subject: hello\n"
+		"Content-Type: multipart/mixed; boundary=foo\n"
+		"\n"
+		"--foo\n"
+		"Content-Type: text/plain; charset=utf-8\n"
+		"Content-Transfer-Encoding: base64\n"
+		"\n"
+		"cMO2w7Y=\n"
+		"--foo\n"
+		"Content-Type: text/plain\n"
+		"\n"
+		"world\n"
+		"--foo--\n";
+	static const char *const keys[] = {
+		"hello", "p\xC3\xB6\xC3\xB6", "nothing", "world"
+	};
+	static const bool expected_matches[][N_ELEMENTS(keys)] = {
+		{ TRUE, TRUE, FALSE, TRUE },
+		{ FALSE, TRUE, FALSE, TRUE },
+	};
+	struct message_search_context *ctxs[N_ELEMENTS(keys)];
+	bool matches[N_ELEMENTS(keys)];
+	struct istream *is;
+	const char *error;
+	unsigned int i, j;
+
+	test_begin("message_search_msg_multi()");
+	is = test_istream_create_data(input, sizeof(input)-1);
+	for (i = 0; i < N_ELEMENTS(expected_matches); i++) {
+		for (j = 0; j < N_ELEMENTS(keys); j++) {
+			ctxs[j] = message_search_init(keys[j], NULL, i == 0 ? 0 :
+				MESSAGE_SEARCH_FLAG_SKIP_HEADERS);
+		}
+		i_stream_seek(is, 0);
+		test_assert_idx(message_search_msg_multi(ctxs, N_ELEMENTS(keys),
+				is, NULL, matches, &error) == 0, i);
+		for (j = 0; j < N_ELEMENTS(keys); j++) {
+			test_assert_idx(matches[j] == expected_matches[i][j],
+					i * 10 + j);
+			message_search_deinit(&ctxs[j]);
+		}
+	}
+	i_stream_unref(&is);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_message_search,
 		test_message_search_more_get_decoded,
+		test_message_search_msg_multi,
 		NULL
 	};
 	return test_run(test_functions);
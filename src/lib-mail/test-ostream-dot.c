@@ -92,11 +92,43 @@ static void test_ostream_dot_parent_almost_full(void)
 	test_end();
 }
 
+static void test_ostream_dot_unbounded_parent(void)
+{
+	buffer_t *output_data;
+	struct ostream *test_output, *output;
+	string_t *input, *expected;
+	unsigned int i;
+
+	test_begin("dot ostream unbounded parent with LF-only lines");
+	input = t_str_new(1024);
+	expected = t_str_new(1024);
+	for (i = 0; i < 100; i++) {
+		str_append(input, "line without CR\n");
+		str_append(expected, "line without CR\r\n");
+	}
+	str_append(expected, ".\r\n");
+
+	output_data = t_buffer_create(1024);
+	test_output = o_stream_create_buffer(output_data);
+	test_assert(o_stream_get_buffer_avail_size(test_output) == SIZE_MAX);
+
+	output = o_stream_create_dot(test_output, FALSE);
+	test_assert(o_stream_send(output, str_data(input), str_len(input)) ==
+		    (ssize_t)str_len(input));
+	test_assert(o_stream_finish(output) > 0);
+	o_stream_unref(&output);
+	o_stream_unref(&test_output);
+
+	test_assert_strcmp(str_c(output_data), str_c(expected));
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_ostream_dot,
 		test_ostream_dot_parent_almost_full,
+		test_ostream_dot_unbounded_parent,
 		NULL
 	};
 	return test_run(test_functions);
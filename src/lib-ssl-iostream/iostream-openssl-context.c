@@ -651,6 +651,7 @@ ssl_iostream_context_set(struct ssl_iostream_context *ctx,
 {
 	ctx->verify_remote_cert = set->verify_remote_cert;
 	ctx->allow_invalid_cert = set->allow_invalid_cert;
+	ctx->ktls = set->ktls;
 
 	if (set->cipher_list != NULL && set->cipher_list[0] != '\0' &&
 	    SSL_CTX_set_cipher_list(ctx->ssl_ctx, set->cipher_list) == 0) {
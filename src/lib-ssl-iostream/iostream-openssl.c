@@ -135,6 +135,35 @@ openssl_iostream_set(struct ssl_iostream *ssl_io)
 	}
 }
 
+#ifdef SSL_OP_ENABLE_KTLS
+static bool openssl_iostream_set_ktls(struct ssl_iostream *ssl_io, BIO *bio_int)
+{
+	struct ostream *output = ssl_io->plain_output;
+	int fd = o_stream_get_fd(output);
+	BIO *bio;
+
+	/* The kernel can encrypt only what OpenSSL writes directly to the
+	   socket, so this works only when plain_output is the socket's own
+	   ostream without anything left in its buffer. The input side keeps
+	   using the BIO pair. */
+	if (fd == -1 || output->real_stream->parent != NULL ||
+	    o_stream_get_buffer_used_size(output) > 0)
+		return FALSE;
+
+	bio = BIO_new_socket(fd, BIO_NOCLOSE);
+	if (bio == NULL) {
+		e_debug(ssl_io->event, "kTLS disabled: BIO_new_socket() failed: %s",
+			openssl_iostream_error());
+		return FALSE;
+	}
+	SSL_set0_rbio(ssl_io->ssl, bio_int);
+	SSL_set0_wbio(ssl_io->ssl, bio);
+	SSL_set_options(ssl_io->ssl, SSL_OP_ENABLE_KTLS);
+	ssl_io->socket_wbio = TRUE;
+	return TRUE;
+}
+#endif
+
 static int
 openssl_iostream_create(struct ssl_iostream_context *ctx,
 			struct event *event_parent, const char *host,
@@ -191,15 +220,18 @@ openssl_iostream_create(struct ssl_iostream_context *ctx,
 		event_set_append_log_prefix(ssl_io->event,
 					    t_strdup_printf("%s: ", host));
 	}
+	o_stream_uncork(ssl_io->plain_output);
+
 	/* bio_int will be freed by SSL_free() */
-	SSL_set_bio(ssl_io->ssl, bio_int, bio_int);
+#ifdef SSL_OP_ENABLE_KTLS
+	if (!ctx->ktls || !openssl_iostream_set_ktls(ssl_io, bio_int))
+#endif
+		SSL_set_bio(ssl_io->ssl, bio_int, bio_int);
         SSL_set_ex_data(ssl_io->ssl, dovecot_ssl_extdata_index, ssl_io);
 	SSL_set_tlsext_host_name(ssl_io->ssl, host);
 
 	openssl_iostream_set(ssl_io);
 
-	o_stream_uncork(ssl_io->plain_output);
-
 	*input = openssl_i_stream_create_ssl(ssl_io);
 	ssl_io->ssl_input = *input;
 
@@ -491,6 +523,14 @@ int openssl_iostream_handle_error(struct ssl_iostream *ssl_io, int ret,
 	err = SSL_get_error(ssl_io->ssl, ret);
 	switch (err) {
 	case SSL_ERROR_WANT_WRITE:
+		if (ssl_io->socket_wbio) {
+			/* OpenSSL writes directly to the socket, which is
+			   full. Continue when it becomes writable. */
+			if (type != OPENSSL_IOSTREAM_SYNC_TYPE_WRITE)
+				ssl_io->istream_waiting_output = TRUE;
+			o_stream_set_flush_pending(ssl_io->plain_output, TRUE);
+			return 0;
+		}
 		if (type != OPENSSL_IOSTREAM_SYNC_TYPE_NONE &&
 		    openssl_iostream_bio_sync(ssl_io, type) == 0) {
 			if (type != OPENSSL_IOSTREAM_SYNC_TYPE_WRITE)
@@ -572,6 +612,17 @@ int openssl_iostream_handle_error(struct ssl_iostream *ssl_io, int ret,
 	return -1;
 }
 
+bool
+openssl_iostream_ktls_send_enabled(struct ssl_iostream *ssl_io ATTR_UNUSED)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	return ssl_io->socket_wbio && ssl_io->handshaked &&
+		BIO_get_ktls_send(SSL_get_wbio(ssl_io->ssl));
+#else
+	return FALSE;
+#endif
+}
+
 static bool
 openssl_iostream_cert_match_name(struct ssl_iostream *ssl_io,
 				 const char *verify_name, const char **reason_r)
@@ -35,6 +35,7 @@ struct ssl_iostream_context {
 	bool client_ctx:1;
 	bool verify_remote_cert:1;
 	bool allow_invalid_cert:1;
+	bool ktls:1;
 };
 
 struct ssl_iostream {
@@ -78,6 +79,9 @@ struct ssl_iostream {
 	   error won't show up. */
 	bool last_error_is_fallback:1;
 	bool ostream_flush_waiting_input:1;
+	/* OpenSSL writes directly to the plain_output's socket (for kTLS) */
+	bool socket_wbio:1;
+	bool istream_waiting_output:1;
 	bool closed:1;
 	bool destroyed:1;
 };
@@ -127,6 +131,10 @@ int openssl_iostream_handle_error(struct ssl_iostream *ssl_io, int ret,
 				  enum openssl_iostream_sync_type type,
 				  const char *func_name);
 
+/* Returns TRUE if the kernel is encrypting the sent data. Anything written
+   directly to the plain_output is then sent as TLS application data. */
+bool openssl_iostream_ktls_send_enabled(struct ssl_iostream *ssl_io);
+
 /* Perform clean shutdown for the connection. */
 void openssl_iostream_shutdown(struct ssl_iostream *ssl_io);
 
@@ -383,7 +383,8 @@ bool ssl_iostream_settings_equals(const struct ssl_iostream_settings *set1,
 	    set1->allow_invalid_cert != set2->allow_invalid_cert ||
 	    set1->prefer_server_ciphers != set2->prefer_server_ciphers ||
 	    set1->compression != set2->compression ||
-	    set1->tickets != set2->tickets)
+	    set1->tickets != set2->tickets ||
+	    set1->ktls != set2->ktls)
 		return FALSE;
 	return TRUE;
 }
@@ -84,6 +84,10 @@ struct ssl_iostream_settings {
 	bool compression;
 	/* If FALSE, set SSL_OP_NO_TICKET. See OpenSSL documentation. */
 	bool tickets;
+	/* Let the kernel encrypt the sent data (kTLS), if supported by the
+	   OpenSSL library and the kernel. This also allows sending files with
+	   sendfile(). */
+	bool ktls;
 };
 
 /* Load SSL module */
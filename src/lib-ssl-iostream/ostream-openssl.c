@@ -97,6 +97,15 @@ o_stream_ssl_buffer(struct ssl_ostream *sstream, const struct const_iovec *iov,
 	return bytes_sent;
 }
 
+static void o_stream_ssl_copy_plain_error(struct ssl_ostream *sstream)
+{
+	struct ostream *plain_output = sstream->ssl_io->plain_output;
+
+	io_stream_set_error(&sstream->ostream.iostream, "%s",
+			    o_stream_get_error(plain_output));
+	sstream->ostream.ostream.stream_errno = plain_output->stream_errno;
+}
+
 static int o_stream_ssl_flush_buffer(struct ssl_ostream *sstream)
 {
 	struct ssl_iostream *ssl_io = sstream->ssl_io;
@@ -105,6 +114,19 @@ static int o_stream_ssl_flush_buffer(struct ssl_ostream *sstream)
 
 	i_assert(!sstream->shutdown);
 
+	if (ssl_io->socket_wbio) {
+		/* SSL_write() writes directly to the socket, so anything
+		   sent via plain_output (see o_stream_ssl_send_istream())
+		   must be flushed first. */
+		ret = o_stream_flush(ssl_io->plain_output);
+		if (ret < 0) {
+			o_stream_ssl_copy_plain_error(sstream);
+			return -1;
+		}
+		if (ret == 0)
+			return 0;
+	}
+
 	while (pos < sstream->buffer->used) {
 		/* we're writing plaintext data to OpenSSL, which it encrypts
 		   and writes to bio_int's buffer. ssl_iostream_bio_sync()
@@ -181,7 +203,9 @@ static int o_stream_ssl_flush(struct ostream_private *stream)
 	/* Stream is finished; shutdown the SSL write direction once our buffer
 	   is empty. */
 	if (stream->finished && !sstream->shutdown && ret >= 0 &&
-	    (sstream->buffer == NULL || sstream->buffer->used == 0)) {
+	    (sstream->buffer == NULL || sstream->buffer->used == 0) &&
+	    (!ssl_io->socket_wbio ||
+	     o_stream_get_buffer_used_size(plain_output) == 0)) {
 		sstream->shutdown = TRUE;
 		if (SSL_shutdown(ssl_io->ssl) < 0) {
 			io_stream_set_error(
@@ -236,11 +260,45 @@ static void o_stream_ssl_switch_ioloop_to(struct ostream_private *stream,
 	o_stream_switch_ioloop_to(sstream->ssl_io->plain_output, ioloop);
 }
 
+static enum ostream_send_istream_result
+o_stream_ssl_send_istream(struct ostream_private *outstream,
+			  struct istream *instream)
+{
+	struct ssl_ostream *sstream = (struct ssl_ostream *)outstream;
+	struct ssl_iostream *ssl_io = sstream->ssl_io;
+	struct ostream *plain_output = ssl_io->plain_output;
+	enum ostream_send_istream_result res;
+	uoff_t old_offset;
+
+	if ((sstream->buffer != NULL && sstream->buffer->used > 0) ||
+	    !openssl_iostream_ktls_send_enabled(ssl_io))
+		return io_stream_copy(&outstream->ostream, instream);
+
+	/* The kernel encrypts everything written to the socket, so the data
+	   doesn't need to go through OpenSSL. This allows plain_output to
+	   use sendfile() and splice(). */
+	old_offset = plain_output->offset;
+	res = o_stream_send_istream(plain_output, instream);
+	outstream->ostream.offset += plain_output->offset - old_offset;
+	if (res == OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT)
+		o_stream_ssl_copy_plain_error(sstream);
+	return res;
+}
+
 static int plain_flush_callback(struct ssl_ostream *sstream)
 {
+	struct ssl_iostream *ssl_io = sstream->ssl_io;
 	struct ostream *ostream = &sstream->ostream.ostream;
 	int ret, ret2;
 
+	if (ssl_io->istream_waiting_output) {
+		/* SSL_read() or handshake was waiting for the socket to
+		   become writable */
+		ssl_io->istream_waiting_output = FALSE;
+		if (ssl_io->ssl_input != NULL)
+			i_stream_set_input_pending(ssl_io->ssl_input, TRUE);
+	}
+
 	/* try to actually flush the pending data */
 	if ((ret = o_stream_flush(sstream->ssl_io->plain_output)) < 0)
 		return -1;
@@ -319,6 +377,7 @@ struct ostream *openssl_o_stream_create_ssl(struct ssl_iostream *ssl_io)
 	sstream->ostream.iostream.destroy = o_stream_ssl_destroy;
 	sstream->ostream.sendv = o_stream_ssl_sendv;
 	sstream->ostream.flush = o_stream_ssl_flush;
+	sstream->ostream.send_istream = o_stream_ssl_send_istream;
 	sstream->ostream.switch_ioloop_to = o_stream_ssl_switch_ioloop_to;
 
 	sstream->ostream.get_buffer_used_size =
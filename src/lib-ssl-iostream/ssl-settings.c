@@ -139,6 +139,7 @@ ssl_settings_check(void *_set, pool_t pool ATTR_UNUSED,
 	/* First set them all to defaults */
 	set->parsed_opts.compression = FALSE;
 	set->parsed_opts.tickets = TRUE;
+	set->parsed_opts.ktls = FALSE;
 
 	/* Then modify anything specified in the string */
 	const char **opts = t_strsplit_spaces(set->ssl_options, ", ");
@@ -148,6 +149,8 @@ ssl_settings_check(void *_set, pool_t pool ATTR_UNUSED,
 			set->parsed_opts.compression = TRUE;
 		} else if (strcasecmp(opt, "no_ticket") == 0) {
 			set->parsed_opts.tickets = FALSE;
+		} else if (strcasecmp(opt, "ktls") == 0) {
+			set->parsed_opts.ktls = TRUE;
 		} else {
 			*error_r = t_strdup_printf("ssl_options: unknown flag: '%s'",
 						   opt);
@@ -251,6 +254,7 @@ ssl_common_settings_to_iostream_set(const struct ssl_settings *ssl_set)
 
 	set->compression = ssl_set->parsed_opts.compression;
 	set->tickets = ssl_set->parsed_opts.tickets;
+	set->ktls = ssl_set->parsed_opts.ktls;
 	set->curve_list = ssl_set->ssl_curve_list;
 	set->cert_hash_algo = ssl_set->ssl_peer_certificate_fingerprint_hash;
 
@@ -26,6 +26,7 @@ struct ssl_settings {
 	struct {
 		bool compression;
 		bool tickets;
+		bool ktls;
 	} parsed_opts;
 };
 
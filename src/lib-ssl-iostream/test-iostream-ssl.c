@@ -381,7 +381,7 @@ static void test_iostream_ssl_handshake(void)
 	test_end();
 }
 
-static void test_iostream_ssl_get_buffer_avail_size(void)
+static void test_iostream_ssl_get_buffer_avail_size_real(bool ktls)
 {
 	struct ssl_iostream_settings set;
 	struct test_endpoint *server, *client;
@@ -389,7 +389,8 @@ static void test_iostream_ssl_get_buffer_avail_size(void)
 	int fd[2];
 	const char *error;
 
-	test_begin("ssl: o_stream_get_buffer_avail_size");
+	test_begin(t_strdup_printf("ssl: o_stream_get_buffer_avail_size%s",
+				   ktls ? " (ktls)" : ""));
 
 	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0)
 		i_fatal("socketpair() failed: %m");
@@ -399,9 +400,11 @@ static void test_iostream_ssl_get_buffer_avail_size(void)
 	ioloop = io_loop_create();
 
 	ssl_iostream_test_settings_server(&set);
+	set.ktls = ktls;
 	server = create_test_endpoint(fd[0], &set);
 	ssl_iostream_test_settings_client(&set);
 	set.allow_invalid_cert = TRUE;
+	set.ktls = ktls;
 	client = create_test_endpoint(fd[1], &set);
 	client->client = TRUE;
 
@@ -473,7 +476,7 @@ static void test_iostream_ssl_get_buffer_avail_size(void)
 	test_end();
 }
 
-static void test_iostream_ssl_small_packets(void)
+static void test_iostream_ssl_small_packets_real(bool ktls)
 {
 	struct ssl_iostream_settings set;
 	struct test_endpoint *server, *client;
@@ -481,7 +484,8 @@ static void test_iostream_ssl_small_packets(void)
 	int fd[2];
 	const char *error;
 
-	test_begin("ssl: small packets");
+	test_begin(t_strdup_printf("ssl: small packets%s",
+				   ktls ? " (ktls)" : ""));
 
 	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0)
 		i_fatal("socketpair() failed: %m");
@@ -491,9 +495,11 @@ static void test_iostream_ssl_small_packets(void)
 	ioloop = io_loop_create();
 
 	ssl_iostream_test_settings_server(&set);
+	set.ktls = ktls;
 	server = create_test_endpoint(fd[0], &set);
 	ssl_iostream_test_settings_client(&set);
 	set.allow_invalid_cert = TRUE;
+	set.ktls = ktls;
 	client = create_test_endpoint(fd[1], &set);
 	client->client = TRUE;
 
@@ -548,6 +554,21 @@ static void test_iostream_ssl_small_packets(void)
 	test_end();
 }
 
+static void test_iostream_ssl_get_buffer_avail_size(void)
+{
+	test_iostream_ssl_get_buffer_avail_size_real(FALSE);
+	/* OpenSSL writes directly to the socket. kTLS itself can't be
+	   enabled for UNIX sockets, so the data is still encrypted by
+	   OpenSSL. */
+	test_iostream_ssl_get_buffer_avail_size_real(TRUE);
+}
+
+static void test_iostream_ssl_small_packets(void)
+{
+	test_iostream_ssl_small_packets_real(FALSE);
+	test_iostream_ssl_small_packets_real(TRUE);
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
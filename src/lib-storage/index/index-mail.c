@@ -389,10 +389,15 @@ int index_mail_get_received_date(struct mail *_mail, time_t *date_r)
 
 	data->cache_fetch_fields |= MAIL_FETCH_RECEIVED_DATE;
 	if (data->received_date == (time_t)-1) {
+		const struct index_mail_dates *dates =
+			index_mail_get_dates_extension(_mail->transaction->view,
+						       _mail->box, _mail->seq);
 		uint32_t t;
 
-		if (index_mail_get_fixed_field(mail, MAIL_CACHE_RECEIVED_DATE,
-						&t, sizeof(t)))
+		if (dates != NULL && dates->received_date != 0)
+			data->received_date = dates->received_date;
+		else if (index_mail_get_fixed_field(mail,
+				MAIL_CACHE_RECEIVED_DATE, &t, sizeof(t)))
 			data->received_date = t;
 	}
 
@@ -418,16 +423,13 @@ int index_mail_get_save_date(struct mail *_mail, time_t *date_r)
 	return *date_r == (time_t)-1 ? -1 : 1;
 }
 
-static int index_mail_cache_sent_date(struct index_mail *mail)
+static int index_mail_parse_sent_date(struct index_mail *mail)
 {
 	struct index_mail_data *data = &mail->data;
 	const char *str;
 	time_t t;
 	int ret, tz;
 
-	if (data->sent_date.time != (uint32_t)-1)
-		return 0;
-
 	if ((ret = mail_get_first_header(&mail->mail.mail, "Date", &str)) < 0)
 		return ret;
 
@@ -440,6 +442,18 @@ static int index_mail_cache_sent_date(struct index_mail *mail)
 	}
 	data->sent_date.time = time_to_uint32_trunc(t);
 	data->sent_date.timezone = tz;
+	return 0;
+}
+
+static int index_mail_cache_sent_date(struct index_mail *mail)
+{
+	struct index_mail_data *data = &mail->data;
+
+	if (data->sent_date.time != (uint32_t)-1)
+		return 0;
+
+	if (index_mail_parse_sent_date(mail) < 0)
+		return -1;
 	index_mail_cache_add(mail, MAIL_CACHE_SENT_DATE,
 			     &data->sent_date, sizeof(data->sent_date));
 	return 0;
@@ -502,6 +516,18 @@ const uint32_t *index_mail_get_vsize_extension(struct mail *_mail)
 	return vsize;
 }
 
+const struct index_mail_dates *
+index_mail_get_dates_extension(struct mail_index_view *view,
+			       struct mailbox *box, uint32_t seq)
+{
+	const void *data;
+	bool expunged ATTR_UNUSED;
+
+	mail_index_lookup_ext(view, seq, box->mail_dates_ext_id,
+			      &data, &expunged);
+	return data;
+}
+
 static void index_mail_try_set_body_size(struct index_mail *mail)
 {
 	struct index_mail_data *data = &mail->data;
@@ -1033,6 +1059,46 @@ static void index_mail_cache_sizes(struct index_mail *mail)
 	}
 }
 
+static void index_mail_update_dates_ext(struct index_mail *mail)
+{
+	struct mail *_mail = &mail->mail.mail;
+	struct index_mail_data *data = &mail->data;
+	const struct index_mail_dates *old_dates;
+	struct index_mail_dates dates;
+	int64_t sent_date_local;
+
+	if (data->no_caching)
+		return;
+
+	old_dates = index_mail_get_dates_extension(_mail->transaction->view,
+						   _mail->box, _mail->seq);
+	if (old_dates == NULL && !_mail->saving) {
+		/* the extension is added when saving new mails. Until then
+		   don't bother adding it to the index. */
+		return;
+	}
+
+	if (old_dates != NULL)
+		dates = *old_dates;
+	else
+		i_zero(&dates);
+	if (dates.received_date == 0 && data->received_date > 0)
+		dates.received_date = time_to_uint32_trunc(data->received_date);
+	if (dates.sent_date_local == 0 &&
+	    data->sent_date.time != (uint32_t)-1) {
+		sent_date_local = (int64_t)data->sent_date.time +
+			data->sent_date.timezone * 60;
+		if (sent_date_local > 0 && sent_date_local < (uint32_t)-1)
+			dates.sent_date_local = sent_date_local;
+	}
+	if (old_dates == NULL ||
+	    memcmp(old_dates, &dates, sizeof(dates)) != 0) {
+		mail_index_update_ext(_mail->transaction->itrans, _mail->seq,
+				      _mail->box->mail_dates_ext_id,
+				      &dates, NULL);
+	}
+}
+
 static void index_mail_cache_dates(struct index_mail *mail)
 {
 	static enum index_cache_field date_fields[] = {
@@ -1056,9 +1122,16 @@ static void index_mail_cache_dates(struct index_mail *mail)
 		}
 	}
 
-	if (mail->data.sent_date_parsed &&
-	    index_mail_want_cache(mail, MAIL_CACHE_SENT_DATE))
-		(void)index_mail_cache_sent_date(mail);
+	if (mail->data.sent_date_parsed) {
+		if (index_mail_want_cache(mail, MAIL_CACHE_SENT_DATE))
+			(void)index_mail_cache_sent_date(mail);
+		else if (mail->mail.mail.saving &&
+			 mail->data.sent_date.time == (uint32_t)-1) {
+			/* not cached, but add it to the dates extension */
+			(void)index_mail_parse_sent_date(mail);
+		}
+	}
+	index_mail_update_dates_ext(mail);
 }
 
 static struct message_part *
@@ -63,6 +63,14 @@ struct mail_sent_date {
 	int32_t timezone;
 };
 
+/* Record in the "dates" index extension. 0 = not known yet. */
+struct index_mail_dates {
+	uint32_t received_date;
+	/* Sent date in its own timezone, i.e. UTC time + timezone offset.
+	   This is what SENT* searches compare against. */
+	uint32_t sent_date_local;
+};
+
 struct index_mail_line {
 	unsigned int field_idx;
 	uint32_t start_pos, end_pos;
@@ -269,6 +277,9 @@ bool index_mail_get_cached_body(struct index_mail *mail, const char **value_r);
 bool index_mail_get_cached_bodystructure(struct index_mail *mail,
 					 const char **value_r);
 const uint32_t *index_mail_get_vsize_extension(struct mail *_mail);
+const struct index_mail_dates *
+index_mail_get_dates_extension(struct mail_index_view *view,
+			       struct mailbox *box, uint32_t seq);
 
 bool index_mail_want_cache(struct index_mail *mail, enum index_cache_field field);
 void index_mail_cache_add(struct index_mail *mail, enum index_cache_field field,
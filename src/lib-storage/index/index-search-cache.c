@@ -0,0 +1,372 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "str.h"
+#include "hex-binary.h"
+#include "sha1.h"
+#include "safe-mkstemp.h"
+#include "istream.h"
+#include "ostream.h"
+#include "imap-seqset.h"
+#include "imap-util.h"
+#include "mail-index-modseq.h"
+#include "index-storage.h"
+#include "mail-search.h"
+#include "index-search-private.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+/* Search results are cached into a dovecot.index.search file next to the
+   index. It's not written via index transactions, so updating it doesn't
+   grow the transaction log or rewrite dovecot.index. The file contains the
+   mailbox's UIDVALIDITY followed by the cached searches, most recently used
+   first:
+
+   <uidvalidity> LF
+   (<highest-modseq> TAB <search query hash> TAB <matching UIDs> LF)*
+
+   The search query is stored only as a SHA1 hash of its IMAP string. The
+   matching UIDs are stored as IMAP sequence set. A cached result is valid
+   for all the messages whose modseq is at most the highest-modseq. Only the
+   messages that are in the cached result or that have changed afterwards
+   need to be searched again. The file is replaced atomically, so with
+   concurrent updates the last writer wins. */
+#define INDEX_SEARCH_CACHE_FILE_SUFFIX ".search"
+/* Maximum number of searches to remember */
+#define INDEX_SEARCH_CACHE_MAX_ENTRIES 8
+/* Don't cache results that take more space than this */
+#define INDEX_SEARCH_CACHE_MAX_UIDSET_LEN 2048
+/* Number of modseqs to look up at once */
+#define INDEX_SEARCH_CACHE_MODSEQ_LOOKUP_COUNT 256
+
+struct index_search_cache_entry {
+	uint64_t modseq;
+	const char *key;
+	const char *uidset;
+};
+ARRAY_DEFINE_TYPE(index_search_cache_entry, struct index_search_cache_entry);
+
+static bool search_arg_is_expensive(const struct mail_search_arg *arg)
+{
+	switch (arg->type) {
+	case SEARCH_BEFORE:
+	case SEARCH_ON:
+	case SEARCH_SINCE:
+	case SEARCH_SMALLER:
+	case SEARCH_LARGER:
+	case SEARCH_HEADER:
+	case SEARCH_HEADER_ADDRESS:
+	case SEARCH_HEADER_COMPRESS_LWSP:
+	case SEARCH_BODY:
+	case SEARCH_TEXT:
+	case SEARCH_GUID:
+	case SEARCH_MIMEPART:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static bool
+search_args_are_cacheable(const struct mail_search_arg *args,
+			  bool *expensive_r)
+{
+	for (; args != NULL; args = args->next) {
+		switch (args->type) {
+		case SEARCH_OR:
+		case SEARCH_SUB:
+			if (!search_args_are_cacheable(args->value.subargs,
+						       expensive_r))
+				return FALSE;
+			break;
+		case SEARCH_ALL:
+		case SEARCH_KEYWORDS:
+			break;
+		case SEARCH_FLAGS:
+			/* \Recent changes without modseq changes */
+			if ((args->value.flags & MAIL_RECENT) != 0)
+				return FALSE;
+			break;
+		case SEARCH_BEFORE:
+		case SEARCH_ON:
+		case SEARCH_SINCE:
+			/* OLDER/YOUNGER are relative to the current time */
+			if ((args->value.search_flags &
+			     MAIL_SEARCH_ARG_FLAG_UTC_TIMES) != 0)
+				return FALSE;
+			break;
+		default:
+			/* sequence sets point to different messages after
+			   expunges, and the rest depend on state that isn't
+			   tracked by modseqs. */
+			if (!search_arg_is_expensive(args))
+				return FALSE;
+			break;
+		}
+		if (search_arg_is_expensive(args))
+			*expensive_r = TRUE;
+	}
+	return TRUE;
+}
+
+static const char *index_search_cache_get_key(struct index_search_context *ctx)
+{
+	struct mail_search_args *args = ctx->mail_ctx.args;
+	unsigned char digest[SHA1_RESULTLEN];
+	string_t *str;
+	const char *error;
+	bool expensive = FALSE;
+
+	if (args->stop_on_nonmatch ||
+	    mailbox_get_private_flags_mask(ctx->box) != 0)
+		return NULL;
+	/* Flag-only searches are already fast, don't bother caching them. */
+	if (!search_args_are_cacheable(args->args, &expensive) || !expensive)
+		return NULL;
+
+	str = t_str_new(128);
+	if (!mail_search_args_to_imap(str, args->args, &error))
+		return NULL;
+	sha1_get_digest(str_data(str), str_len(str), digest);
+	return binary_to_hex(digest, sizeof(digest));
+}
+
+static const char *index_search_cache_get_path(struct mailbox *box)
+{
+	return t_strconcat(box->index->filepath,
+			   INDEX_SEARCH_CACHE_FILE_SUFFIX, NULL);
+}
+
+static void
+index_search_cache_read(struct index_search_context *ctx,
+			ARRAY_TYPE(index_search_cache_entry) *entries)
+{
+	const struct mail_index_header *hdr =
+		mail_index_get_header(ctx->view);
+	const char *path = index_search_cache_get_path(ctx->box);
+	const char *line, *const *args;
+	struct index_search_cache_entry entry;
+	struct istream *input;
+	uint32_t uid_validity;
+
+	input = i_stream_create_file(path, SIZE_MAX);
+	if ((line = i_stream_read_next_line(input)) == NULL ||
+	    str_to_uint32(line, &uid_validity) < 0 ||
+	    uid_validity != hdr->uid_validity) {
+		/* missing, broken or outdated file */
+	} else {
+		while (array_count(entries) < INDEX_SEARCH_CACHE_MAX_ENTRIES &&
+		       (line = i_stream_read_next_line(input)) != NULL) {
+			args = t_strsplit(line, "\t");
+			i_zero(&entry);
+			if (str_array_length(args) != 3 ||
+			    str_to_uint64(args[0], &entry.modseq) < 0)
+				continue;
+			entry.key = args[1];
+			entry.uidset = args[2];
+			array_push_back(entries, &entry);
+		}
+	}
+	if (input->stream_errno != 0 && input->stream_errno != ENOENT) {
+		e_error(ctx->box->event, "Failed to read search cache: %s",
+			i_stream_get_error(input));
+	}
+	i_stream_unref(&input);
+}
+
+static int
+index_search_cache_get_uids(const char *uidset, ARRAY_TYPE(seq_range) *uids)
+{
+	const char *const *ranges;
+	uint32_t uid1, uid2;
+
+	if (uidset[0] == '\0')
+		return 0;
+	for (ranges = t_strsplit(uidset, ","); *ranges != NULL; ranges++) {
+		if (imap_seq_range_parse(*ranges, &uid1, &uid2) < 0)
+			return -1;
+		seq_range_array_add_range(uids, uid1, uid2);
+	}
+	return 0;
+}
+
+static void
+index_search_cache_set_seqs(struct index_search_context *ctx,
+			    const struct index_search_cache_entry *entry)
+{
+	ARRAY_TYPE(seq_range) uids;
+	const struct seq_range *range;
+	uint64_t modseqs[INDEX_SEARCH_CACHE_MODSEQ_LOOKUP_COUNT];
+	uint32_t seq, seq1, seq2, count, lookup_count, i;
+
+	t_array_init(&uids, 32);
+	if (index_search_cache_get_uids(entry->uidset, &uids) < 0)
+		return;
+
+	/* search the messages that matched earlier and the messages that
+	   have changed since then */
+	i_array_init(&ctx->search_cache_seqs, array_count(&uids) + 32);
+	array_foreach(&uids, range) {
+		if (mail_index_lookup_seq_range(ctx->view, range->seq1,
+						range->seq2, &seq1, &seq2)) {
+			seq_range_array_add_range(&ctx->search_cache_seqs,
+						  seq1, seq2);
+		}
+	}
+	count = mail_index_view_get_messages_count(ctx->view);
+	for (seq = 1; seq <= count; seq += lookup_count) {
+		lookup_count = I_MIN(N_ELEMENTS(modseqs), count - seq + 1);
+		mail_index_modseq_lookup_range(ctx->view, seq,
+					       seq + lookup_count - 1, modseqs);
+		for (i = 0; i < lookup_count; i++) {
+			if (modseqs[i] > entry->modseq) {
+				seq_range_array_add(&ctx->search_cache_seqs,
+						    seq + i);
+			}
+		}
+	}
+
+	if (array_count(&ctx->search_cache_seqs) == 0) {
+		/* nothing can match */
+		ctx->seq1 = 1;
+		ctx->seq2 = 0;
+		return;
+	}
+	range = array_front(&ctx->search_cache_seqs);
+	if (ctx->seq1 < range->seq1)
+		ctx->seq1 = range->seq1;
+	range = array_back(&ctx->search_cache_seqs);
+	if (ctx->seq2 > range->seq2)
+		ctx->seq2 = range->seq2;
+}
+
+void index_search_cache_init(struct index_search_context *ctx)
+{
+	ARRAY_TYPE(index_search_cache_entry) entries;
+	const struct index_search_cache_entry *entry;
+	const char *key;
+
+	key = index_search_cache_get_key(ctx);
+	if (key == NULL)
+		return;
+
+	/* The cache is usable only when modseqs are being tracked. Don't
+	   enable the tracking here, since it makes all the following flag
+	   changes more expensive. */
+	if (!mail_index_have_modseq_tracking(ctx->box->index) ||
+	    MAIL_INDEX_IS_IN_MEMORY(ctx->box->index))
+		return;
+
+	ctx->search_cache_key = i_strdup(key);
+	ctx->search_cache_modseq = mail_index_modseq_get_highest(ctx->view);
+	i_array_init(&ctx->search_cache_uids, 32);
+
+	t_array_init(&entries, INDEX_SEARCH_CACHE_MAX_ENTRIES);
+	index_search_cache_read(ctx, &entries);
+	array_foreach(&entries, entry) {
+		if (strcmp(entry->key, key) == 0 &&
+		    entry->modseq <= ctx->search_cache_modseq) {
+			index_search_cache_set_seqs(ctx, entry);
+			break;
+		}
+	}
+}
+
+static void
+index_search_cache_write(struct index_search_context *ctx,
+			 const ARRAY_TYPE(index_search_cache_entry) *entries)
+{
+	const struct mail_index_header *hdr =
+		mail_index_get_header(ctx->view);
+	const struct mailbox_permissions *perm =
+		mailbox_get_permissions(ctx->box);
+	const char *path = index_search_cache_get_path(ctx->box);
+	const struct index_search_cache_entry *entry;
+	struct ostream *output;
+	string_t *temp_path = t_str_new(128);
+	int fd, ret = 0;
+
+	str_append(temp_path, path);
+	fd = safe_mkstemp_hostpid_group(temp_path, perm->file_create_mode,
+					perm->file_create_gid,
+					perm->file_create_gid_origin);
+	if (fd == -1) {
+		e_error(ctx->box->event, "safe_mkstemp(%s) failed: %m",
+			str_c(temp_path));
+		return;
+	}
+
+	output = o_stream_create_fd(fd, 0);
+	o_stream_cork(output);
+	o_stream_nsend_str(output, t_strdup_printf("%u\n", hdr->uid_validity));
+	array_foreach(entries, entry) {
+		o_stream_nsend_str(output, t_strdup_printf(
+			"%"PRIu64"\t%s\t%s\n",
+			entry->modseq, entry->key, entry->uidset));
+	}
+	if (o_stream_finish(output) < 0) {
+		e_error(ctx->box->event, "write(%s) failed: %s",
+			str_c(temp_path), o_stream_get_error(output));
+		ret = -1;
+	}
+	o_stream_destroy(&output);
+	if (close(fd) < 0) {
+		e_error(ctx->box->event, "close(%s) failed: %m",
+			str_c(temp_path));
+		ret = -1;
+	} else if (ret == 0 && rename(str_c(temp_path), path) < 0) {
+		e_error(ctx->box->event, "rename(%s, %s) failed: %m",
+			str_c(temp_path), path);
+		ret = -1;
+	}
+	if (ret < 0)
+		i_unlink(str_c(temp_path));
+}
+
+void index_search_cache_deinit(struct index_search_context *ctx)
+{
+	ARRAY_TYPE(index_search_cache_entry) old_entries, new_entries;
+	const struct index_search_cache_entry *entry;
+	struct index_search_cache_entry new_entry;
+	string_t *uidset;
+
+	if (ctx->search_cache_key != NULL &&
+	    ctx->search_cache_finished && !ctx->failed &&
+	    !ctx->mail_ctx.seen_lost_data) T_BEGIN {
+		uidset = t_str_new(128);
+		imap_write_seq_range(uidset, &ctx->search_cache_uids);
+
+		i_zero(&new_entry);
+		new_entry.modseq = ctx->search_cache_modseq;
+		new_entry.uidset = str_c(uidset);
+		new_entry.key = ctx->search_cache_key;
+
+		t_array_init(&old_entries, INDEX_SEARCH_CACHE_MAX_ENTRIES);
+		t_array_init(&new_entries, INDEX_SEARCH_CACHE_MAX_ENTRIES);
+		index_search_cache_read(ctx, &old_entries);
+		entry = array_count(&old_entries) == 0 ? NULL :
+			array_front(&old_entries);
+		if (str_len(uidset) > INDEX_SEARCH_CACHE_MAX_UIDSET_LEN) {
+			/* too large */
+		} else if (entry != NULL && entry->modseq == new_entry.modseq &&
+			   strcmp(entry->key, new_entry.key) == 0) {
+			/* already up-to-date */
+		} else {
+			array_push_back(&new_entries, &new_entry);
+			array_foreach(&old_entries, entry) {
+				if (array_count(&new_entries) >=
+				    INDEX_SEARCH_CACHE_MAX_ENTRIES)
+					break;
+				if (strcmp(entry->key, new_entry.key) != 0)
+					array_push_back(&new_entries, entry);
+			}
+			index_search_cache_write(ctx, &new_entries);
+		}
+	} T_END;
+
+	array_free(&ctx->search_cache_uids);
+	array_free(&ctx->search_cache_seqs);
+	i_free(ctx->search_cache_key);
+}
@@ -19,6 +19,24 @@ struct index_search_context {
 	struct mailbox_header_lookup_ctx *extra_wanted_headers;
 
 	uint32_t seq1, seq2;
+	/* Cache records have been prefetched up to this sequence */
+	uint32_t cache_prefetch_seq;
+
+	/* Search result caching, see index-search-cache.c */
+	char *search_cache_key;
+	uint64_t search_cache_modseq;
+	/* If created, only these messages need to be searched */
+	ARRAY_TYPE(seq_range) search_cache_seqs;
+	/* UIDs of the matched messages */
+	ARRAY_TYPE(seq_range) search_cache_uids;
+	/* Root level flags, keywords and date args that are checked for a
+	   chunk of messages at a time before searching them */
+	ARRAY(struct mail_search_arg *) index_prefilter_args;
+	/* Messages in the current chunk that match index_prefilter_args. The
+	   chunk ends before index_seqs_next_seq. */
+	ARRAY_TYPE(seq_range) index_seqs;
+	unsigned int index_seqs_idx;
+	uint32_t index_seqs_next_seq;
 	struct mail *cur_mail;
 	struct index_mail *cur_imail;
 	struct mail_thread_context *thread_ctx;
@@ -33,11 +51,19 @@ struct index_search_context {
 	bool have_seqsets:1;
 	bool have_index_args:1;
 	bool have_mailbox_args:1;
+	bool have_body_args:1;
+	bool search_cache_finished:1;
 	bool have_nonmatch_always:1;
 };
 
 struct mail *index_search_get_mail(struct index_search_context *ctx);
 
+/* Use a cached result of an earlier identical search to limit the messages
+   that need to be searched, if possible. */
+void index_search_cache_init(struct index_search_context *ctx);
+/* Update the cached search result if the search was finished. */
+void index_search_cache_deinit(struct index_search_context *ctx);
+
 int index_search_mime_arg_match(struct mail_search_arg *args,
 	struct index_search_context *ctx);
 void index_search_mime_arg_deinit(struct mail_search_arg *arg,
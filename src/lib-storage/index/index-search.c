@@ -40,6 +40,14 @@
    milliseconds, fail the search with MAIL_ERRSTR_INTERRUPTED. */
 #define SEARCH_INTERRUPT_DELAY_MSECS 2000
 
+/* Number of messages whose cache records are prefetched at a time */
+#define SEARCH_CACHE_PREFETCH_COUNT 1024
+/* Number of messages checked against the index prefilter args at a time */
+#define SEARCH_INDEX_PREFILTER_COUNT 1024
+/* Number of mails prefetched when searching message bodies and
+   mail_prefetch_count=0 */
+#define SEARCH_BODY_PREFETCH_COUNT 16
+
 struct search_header_context {
         struct index_search_context *index_ctx;
         struct index_mail *imail;
@@ -55,10 +63,16 @@ struct search_header_context {
 	bool threading:1;
 };
 
+ARRAY_DEFINE_TYPE(mail_search_arg_p, struct mail_search_arg *);
+
 struct search_body_context {
         struct index_search_context *index_ctx;
 	struct istream *input;
 	struct message_part *part;
+
+	/* BODY and TEXT args are searched separately, since TEXT also
+	   searches the headers */
+	ARRAY_TYPE(mail_search_arg_p) body_args, text_args;
 };
 
 static void search_parse_msgset_args(unsigned int messages_count,
@@ -134,6 +148,10 @@ static void search_init_arg(struct mail_search_arg *arg,
 	case SEARCH_MAILBOX_GLOB:
 		ctx->have_mailbox_args = TRUE;
 		break;
+	case SEARCH_BODY:
+	case SEARCH_TEXT:
+		ctx->have_body_args = TRUE;
+		break;
 	case SEARCH_ALL:
 		if (!arg->match_not)
 			arg->match_always = TRUE;
@@ -158,34 +176,40 @@ static void search_seqset_arg(struct mail_search_arg *arg,
 	}
 }
 
-static int search_arg_match_keywords(struct index_search_context *ctx,
-				     struct mail_search_arg *arg)
+static bool
+search_index_keywords_match(const struct mail_keywords *search_kws,
+			    const ARRAY_TYPE(keyword_indexes) *keyword_indexes)
 {
-	ARRAY_TYPE(keyword_indexes) keyword_indexes_arr;
-	const struct mail_keywords *search_kws = arg->initialized.keywords;
-	const unsigned int *keyword_indexes;
+	const unsigned int *indexes;
 	unsigned int i, j, count;
 
 	if (search_kws->count == 0) {
 		/* invalid keyword - never matches */
-		return 0;
+		return FALSE;
 	}
-
-	t_array_init(&keyword_indexes_arr, 128);
-	mail_index_lookup_keywords(ctx->view, ctx->mail_ctx.seq,
-				   &keyword_indexes_arr);
-	keyword_indexes = array_get(&keyword_indexes_arr, &count);
-
+	indexes = array_get(keyword_indexes, &count);
 	/* there probably aren't many keywords, so O(n*m) for now */
 	for (i = 0; i < search_kws->count; i++) {
 		for (j = 0; j < count; j++) {
-			if (search_kws->idx[i] == keyword_indexes[j])
+			if (search_kws->idx[i] == indexes[j])
 				break;
 		}
 		if (j == count)
-			return 0;
+			return FALSE;
 	}
-	return 1;
+	return TRUE;
+}
+
+static int search_arg_match_keywords(struct index_search_context *ctx,
+				     struct mail_search_arg *arg)
+{
+	ARRAY_TYPE(keyword_indexes) keyword_indexes_arr;
+
+	t_array_init(&keyword_indexes_arr, 128);
+	mail_index_lookup_keywords(ctx->view, ctx->mail_ctx.seq,
+				   &keyword_indexes_arr);
+	return search_index_keywords_match(arg->initialized.keywords,
+					   &keyword_indexes_arr) ? 1 : 0;
 }
 
 static bool
@@ -322,12 +346,34 @@ static void search_mailbox_arg(struct mail_search_arg *arg,
 	}
 }
 
+static int search_date_match(enum mail_search_arg_type type, time_t date,
+			     time_t search_time)
+{
+	switch (type) {
+	case SEARCH_BEFORE:
+		return date < search_time ? 1 : 0;
+	case SEARCH_ON:
+		return (date >= search_time &&
+			date < search_time + 3600*24) ? 1 : 0;
+	case SEARCH_SINCE:
+		return date >= search_time ? 1 : 0;
+	default:
+		i_unreached();
+	}
+}
+
+static time_t search_date_get_local(time_t date)
+{
+	struct tm *tm = localtime(&date);
+
+	return date + utc_offset(tm, date) * 60;
+}
+
 /* Returns >0 = matched, 0 = not matched, -1 = unknown */
 static int search_arg_match_cached(struct index_search_context *ctx,
 				   struct mail_search_arg *arg)
 {
 	const char *str;
-	struct tm *tm;
 	uoff_t virtual_size;
 	time_t date;
 	int tz_offset;
@@ -364,24 +410,12 @@ static int search_arg_match_cached(struct index_search_context *ctx,
 
 		if ((arg->value.search_flags &
 		     MAIL_SEARCH_ARG_FLAG_UTC_TIMES) == 0) {
-			if (!have_tz_offset) {
-				tm = localtime(&date);
-				tz_offset = utc_offset(tm, date);
-			}
-			date += tz_offset * 60;
-		}
-
-		switch (arg->type) {
-		case SEARCH_BEFORE:
-			return date < arg->value.time ? 1 : 0;
-		case SEARCH_ON:
-			return (date >= arg->value.time &&
-				date < arg->value.time + 3600*24) ? 1 : 0;
-		case SEARCH_SINCE:
-			return date >= arg->value.time ? 1 : 0;
-		default:
-			i_unreached();
+			if (have_tz_offset)
+				date += tz_offset * 60;
+			else
+				date = search_date_get_local(date);
 		}
+		return search_date_match(arg->type, date, arg->value.time);
 
 	/* save date attribute */
 	case SEARCH_SAVEDATESUPPORTED:
@@ -456,18 +490,7 @@ static int search_sent(enum mail_search_arg_type type, time_t search_time,
 				&sent_time, &timezone_offset))
 		return 0;
 	sent_time += timezone_offset * 60;
-
-	switch (type) {
-	case SEARCH_BEFORE:
-		return sent_time < search_time ? 1 : 0;
-	case SEARCH_ON:
-		return (sent_time >= search_time &&
-			sent_time < search_time + 3600*24) ? 1 : 0;
-	case SEARCH_SINCE:
-		return sent_time >= search_time ? 1 : 0;
-	default:
-                i_unreached();
-	}
+	return search_date_match(type, sent_time, search_time);
 }
 
 static struct message_search_context *
@@ -705,10 +728,6 @@ static void search_header(struct message_header_line *hdr,
 static void search_body(struct mail_search_arg *arg,
 			struct search_body_context *ctx)
 {
-	struct message_search_context *msg_search_ctx;
-	const char *error;
-	int ret;
-
 	switch (arg->type) {
 	case SEARCH_BODY:
 	case SEARCH_TEXT:
@@ -717,20 +736,47 @@ static void search_body(struct mail_search_arg *arg,
 		return;
 	}
 
-	msg_search_ctx = msg_search_arg_context(ctx->index_ctx, arg);
-	if (msg_search_ctx == NULL) {
+	if (msg_search_arg_context(ctx->index_ctx, arg) == NULL) {
 		ARG_SET_RESULT(arg, 0);
 		return;
 	}
+	if (arg->type == SEARCH_BODY)
+		array_push_back(&ctx->body_args, &arg);
+	else
+		array_push_back(&ctx->text_args, &arg);
+}
+
+static void search_body_args(struct search_body_context *ctx,
+			     ARRAY_TYPE(mail_search_arg_p) *args)
+{
+	struct mail_search_arg *const *argp;
+	struct message_search_context **msg_search_ctxs;
+	const char *error;
+	bool *matches;
+	unsigned int i, count;
+	int ret;
+
+	argp = array_get(args, &count);
+	if (count == 0)
+		return;
+
+	/* search all the keys while parsing and decoding the mail once */
+	msg_search_ctxs = t_new(struct message_search_context *, count);
+	matches = t_new(bool, count);
+	for (i = 0; i < count; i++)
+		msg_search_ctxs[i] = argp[i]->context;
 
 	i_stream_seek(ctx->input, 0);
-	ret = message_search_msg(msg_search_ctx, ctx->input, ctx->part, &error);
+	ret = message_search_msg_multi(msg_search_ctxs, count, ctx->input,
+				       ctx->part, matches, &error);
 	if (ret < 0 && ctx->input->stream_errno == 0) {
 		/* try again without cached parts */
 		index_mail_set_message_parts_corrupted(ctx->index_ctx->cur_mail, error);
 
 		i_stream_seek(ctx->input, 0);
-		ret = message_search_msg(msg_search_ctx, ctx->input, NULL, &error);
+		ret = message_search_msg_multi(msg_search_ctxs, count,
+					       ctx->input, NULL, matches,
+					       &error);
 		i_assert(ret >= 0 || ctx->input->stream_errno != 0);
 	}
 	if (ctx->input->stream_errno != 0) {
@@ -739,7 +785,12 @@ static void search_body(struct mail_search_arg *arg,
 			i_stream_get_error(ctx->input));
 	}
 
-	ARG_SET_RESULT(arg, ret);
+	for (i = 0; i < count; i++) {
+		if (ret < 0)
+			ARG_SET_RESULT(argp[i], -1);
+		else
+			ARG_SET_RESULT(argp[i], matches[i] ? 1 : 0);
+	}
 }
 
 static int search_arg_match_text(struct mail_search_arg *args,
@@ -874,7 +925,14 @@ static int search_arg_match_text(struct mail_search_arg *args,
 	(void)mail_get_parts(ctx->cur_mail, &body_ctx.part);
 	ctx->cur_mail->lookup_abort = MAIL_LOOKUP_ABORT_NEVER;
 
-	return mail_search_args_foreach(args, search_body, &body_ctx);
+	T_BEGIN {
+		t_array_init(&body_ctx.body_args, 4);
+		t_array_init(&body_ctx.text_args, 4);
+		(void)mail_search_args_foreach(args, search_body, &body_ctx);
+		search_body_args(&body_ctx, &body_ctx.body_args);
+		search_body_args(&body_ctx, &body_ctx.text_args);
+	} T_END;
+	return mail_search_args_foreach(args, search_none, NULL);
 }
 
 static bool
@@ -1147,6 +1205,149 @@ static void search_get_seqset(struct index_search_context *ctx,
 	}
 }
 
+static bool
+search_arg_is_index_prefilter(struct index_search_context *ctx,
+			      const struct mail_search_arg *arg)
+{
+	enum mail_flags pvt_flags_mask;
+
+	switch (arg->type) {
+	case SEARCH_FLAGS:
+		/* \Recent and private flags aren't in the shared records */
+		pvt_flags_mask = ctx->box->view_pvt == NULL ? 0 :
+			mailbox_get_private_flags_mask(ctx->box);
+		return (arg->value.flags & (MAIL_RECENT | pvt_flags_mask)) == 0;
+	case SEARCH_KEYWORDS:
+		return TRUE;
+	case SEARCH_BEFORE:
+	case SEARCH_ON:
+	case SEARCH_SINCE:
+		/* these dates are in the "dates" extension */
+		switch (arg->value.date_type) {
+		case MAIL_SEARCH_DATE_TYPE_SENT:
+			/* only the sent date's local time is stored */
+			return (arg->value.search_flags &
+				MAIL_SEARCH_ARG_FLAG_UTC_TIMES) == 0;
+		case MAIL_SEARCH_DATE_TYPE_RECEIVED:
+			return TRUE;
+		case MAIL_SEARCH_DATE_TYPE_SAVED:
+			break;
+		}
+		return FALSE;
+	default:
+		return FALSE;
+	}
+}
+
+/* Returns >0 = matched, 0 = not matched, -1 = unknown */
+static int
+search_arg_match_index_prefilter(struct index_search_context *ctx,
+				 const struct mail_search_arg *arg,
+				 uint32_t seq,
+				 const struct mail_index_record *rec,
+				 const ARRAY_TYPE(keyword_indexes) *keyword_indexes)
+{
+	const struct index_mail_dates *dates;
+	time_t date;
+
+	switch (arg->type) {
+	case SEARCH_FLAGS:
+		return (rec->flags & arg->value.flags) == arg->value.flags ?
+			1 : 0;
+	case SEARCH_KEYWORDS:
+		return search_index_keywords_match(arg->initialized.keywords,
+						   keyword_indexes) ? 1 : 0;
+	case SEARCH_BEFORE:
+	case SEARCH_ON:
+	case SEARCH_SINCE:
+		dates = index_mail_get_dates_extension(ctx->view, ctx->box,
+						       seq);
+		if (dates == NULL)
+			return -1;
+		if (arg->value.date_type == MAIL_SEARCH_DATE_TYPE_SENT) {
+			if (dates->sent_date_local == 0)
+				return -1;
+			date = dates->sent_date_local;
+		} else {
+			if (dates->received_date == 0)
+				return -1;
+			date = dates->received_date;
+			if ((arg->value.search_flags &
+			     MAIL_SEARCH_ARG_FLAG_UTC_TIMES) == 0)
+				date = search_date_get_local(date);
+		}
+		return search_date_match(arg->type, date, arg->value.time);
+	default:
+		i_unreached();
+	}
+}
+
+static void search_init_index_prefilter(struct index_search_context *ctx,
+					struct mail_search_arg *args)
+{
+	struct mail_search_arg *arg;
+
+	/* The root level args are ANDed together. Find the flags, keywords
+	   and date args there and check them for a chunk of messages in one
+	   pass instead of evaluating the whole search tree for each message.
+	   Only the messages that can still match are then searched. The dates
+	   are looked up from the "dates" index extension, which avoids
+	   reading the cache file for the non-matching messages. The chunks
+	   are checked only when the search gets to them, so finding the
+	   first matches doesn't require going through the whole mailbox. */
+	for (arg = args; arg != NULL; arg = arg->next) {
+		if (!search_arg_is_index_prefilter(ctx, arg))
+			continue;
+		if (!array_is_created(&ctx->index_prefilter_args))
+			i_array_init(&ctx->index_prefilter_args, 8);
+		array_push_back(&ctx->index_prefilter_args, &arg);
+	}
+	if (array_is_created(&ctx->index_prefilter_args)) {
+		i_array_init(&ctx->index_seqs, 64);
+		ctx->index_seqs_next_seq = ctx->seq1;
+	}
+}
+
+static void search_get_index_seqs(struct index_search_context *ctx,
+				  uint32_t seq1)
+{
+	ARRAY_TYPE(keyword_indexes) keyword_indexes;
+	struct mail_search_arg *arg;
+	const struct mail_index_record *rec;
+	bool match, have_keywords;
+	uint32_t seq, seq2;
+	int ret;
+
+	seq2 = ctx->seq2 - seq1 < SEARCH_INDEX_PREFILTER_COUNT ?
+		ctx->seq2 : seq1 + SEARCH_INDEX_PREFILTER_COUNT - 1;
+
+	t_array_init(&keyword_indexes, 32);
+	array_clear(&ctx->index_seqs);
+	ctx->index_seqs_idx = 0;
+	for (seq = seq1; seq <= seq2; seq++) {
+		rec = mail_index_lookup(ctx->view, seq);
+		have_keywords = FALSE;
+		match = TRUE;
+		array_foreach_elem(&ctx->index_prefilter_args, arg) {
+			if (arg->type == SEARCH_KEYWORDS && !have_keywords) {
+				array_clear(&keyword_indexes);
+				mail_index_lookup_keywords(ctx->view, seq,
+							   &keyword_indexes);
+				have_keywords = TRUE;
+			}
+			ret = search_arg_match_index_prefilter(ctx, arg, seq,
+							       rec, &keyword_indexes);
+			if (ret >= 0 && (ret > 0) == arg->match_not) {
+				match = FALSE;
+				break;
+			}
+		}
+		if (match)
+			seq_range_array_add(&ctx->index_seqs, seq);
+	}
+	ctx->index_seqs_next_seq = seq2 + 1;
+}
+
 static int search_build_subthread(struct mail_thread_iterate_context *iter,
 				  ARRAY_TYPE(seq_range) *uids)
 {
@@ -1349,6 +1550,18 @@ index_storage_search_init(struct mailbox_transaction_context *t,
 
 	search_get_seqset(ctx, status.messages, args->args);
 	(void)mail_search_args_foreach(args->args, search_init_arg, ctx);
+	index_search_cache_init(ctx);
+	search_init_index_prefilter(ctx, args->args);
+
+	if (ctx->have_body_args && ctx->mail_ctx.max_mails == 1 &&
+	    ctx->mail_ctx.sort_program == NULL &&
+	    (t->box->storage->class_flags &
+	     MAIL_STORAGE_CLASS_FLAG_FILE_PER_MSG) != 0) {
+		/* Searching message bodies is mostly waiting for disk I/O.
+		   Have the kernel read the following mails while the current
+		   one is being parsed and searched. */
+		ctx->mail_ctx.max_mails = SEARCH_BODY_PREFETCH_COUNT;
+	}
 
 	/* Need to reset results for match_always cases */
 	mail_search_args_reset(ctx->mail_ctx.args->args, FALSE);
@@ -1384,6 +1597,9 @@ int index_storage_search_deinit(struct mail_search_context *_ctx)
 	(void)mail_search_args_foreach(ctx->mail_ctx.args->args,
 				       search_arg_deinit, ctx);
 
+	index_search_cache_deinit(ctx);
+	array_free(&ctx->index_prefilter_args);
+	array_free(&ctx->index_seqs);
 	mailbox_header_lookup_unref(&ctx->mail_ctx.wanted_headers);
 	if (ctx->mail_ctx.sort_program != NULL) {
 		if (index_sort_program_deinit(&ctx->mail_ctx.sort_program) < 0)
@@ -1805,6 +2021,16 @@ static int search_more(struct index_search_context *ctx,
 		}
 		mailbox_search_notify(ctx->box, &ctx->mail_ctx);
 	}
+	if (ctx->search_cache_key == NULL)
+		;
+	else if (ret > 0 && (*mail_r)->uid == 0) {
+		/* uncommitted mail matched - don't cache the result */
+		i_free(ctx->search_cache_key);
+	} else if (ret > 0) {
+		seq_range_array_add(&ctx->search_cache_uids,
+				    (*mail_r)->uid);
+	} else if (ret < 0)
+		ctx->search_cache_finished = TRUE;
 	return ret;
 }
 
@@ -1885,6 +2111,63 @@ bool index_storage_search_next_nonblock(struct mail_search_context *_ctx,
 	return TRUE;
 }
 
+static void search_cache_prefetch(struct index_search_context *ctx)
+{
+	struct mail_search_context *_ctx = &ctx->mail_ctx;
+	uint32_t seq2;
+
+	if (_ctx->seq <= ctx->cache_prefetch_seq)
+		return;
+	if (_ctx->wanted_fields == 0 && _ctx->wanted_headers == NULL)
+		return;
+
+	/* Read the cache records of the following messages in the order
+	   they exist in the cache file instead of doing random reads for
+	   each message separately. */
+	seq2 = ctx->seq2 - _ctx->seq < SEARCH_CACHE_PREFETCH_COUNT ?
+		ctx->seq2 : _ctx->seq + SEARCH_CACHE_PREFETCH_COUNT - 1;
+	mail_cache_prefetch(_ctx->transaction->cache_view, _ctx->seq, seq2);
+	ctx->cache_prefetch_seq = seq2;
+}
+
+static void search_index_seqs_skip(struct index_search_context *ctx)
+{
+	struct mail_search_context *_ctx = &ctx->mail_ctx;
+	const struct seq_range *range;
+	unsigned int count;
+
+	/* skip over the messages that can't match the prefilter args */
+	while (_ctx->seq <= ctx->seq2) {
+		if (_ctx->seq >= ctx->index_seqs_next_seq) T_BEGIN {
+			search_get_index_seqs(ctx, _ctx->seq);
+		} T_END;
+
+		range = array_get(&ctx->index_seqs, &count);
+		while (ctx->index_seqs_idx < count &&
+		       range[ctx->index_seqs_idx].seq2 < _ctx->seq)
+			ctx->index_seqs_idx++;
+		if (ctx->index_seqs_idx < count) {
+			if (_ctx->seq < range[ctx->index_seqs_idx].seq1)
+				_ctx->seq = range[ctx->index_seqs_idx].seq1;
+			return;
+		}
+		/* nothing matches in the rest of this chunk */
+		_ctx->seq = ctx->index_seqs_next_seq;
+	}
+}
+
+static void search_index_prefilter_set_results(struct index_search_context *ctx)
+{
+	struct mail_search_arg *arg;
+
+	/* The flags and keywords were already fully checked for this message
+	   by the prefilter, so they don't need to be looked up again. */
+	array_foreach_elem(&ctx->index_prefilter_args, arg) {
+		if (arg->type == SEARCH_FLAGS || arg->type == SEARCH_KEYWORDS)
+			arg->result = 1;
+	}
+}
+
 bool index_storage_search_next_update_seq(struct mail_search_context *_ctx)
 {
         struct index_search_context *ctx = (struct index_search_context *)_ctx;
@@ -1899,16 +2182,33 @@ bool index_storage_search_next_update_seq(struct mail_search_context *_ctx)
 	}
 
 	if (!ctx->have_seqsets && !ctx->have_index_args &&
-	    !ctx->have_nonmatch_always && _ctx->update_result == NULL) {
+	    !ctx->have_nonmatch_always && _ctx->update_result == NULL &&
+	    !array_is_created(&ctx->search_cache_seqs)) {
 		_ctx->progress_cur = _ctx->seq;
-		return _ctx->seq <= ctx->seq2;
+		if (_ctx->seq > ctx->seq2)
+			return FALSE;
+		search_cache_prefetch(ctx);
+		return TRUE;
 	}
 
 	ret = 0;
 	while (_ctx->seq <= ctx->seq2) {
+		if (array_is_created(&ctx->index_seqs)) {
+			search_index_seqs_skip(ctx);
+			if (_ctx->seq > ctx->seq2)
+				break;
+			search_index_prefilter_set_results(ctx);
+		}
 		/* check if the sequence matches */
-		ret = mail_search_args_foreach(ctx->mail_ctx.args->args,
-					       search_seqset_arg, ctx);
+		if (array_is_created(&ctx->search_cache_seqs) &&
+		    !seq_range_exists(&ctx->search_cache_seqs, _ctx->seq)) {
+			/* didn't match in the cached search result and
+			   hasn't changed since */
+			ret = 0;
+		} else {
+			ret = mail_search_args_foreach(ctx->mail_ctx.args->args,
+						       search_seqset_arg, ctx);
+		}
 		if (ret != 0 && ctx->have_index_args) {
 			/* check if flags/keywords match before anything else
 			   is done. mail_set_seq() can be a bit slow. */
@@ -1939,5 +2239,7 @@ bool index_storage_search_next_update_seq(struct mail_search_context *_ctx)
 		}
 	}
 	ctx->mail_ctx.progress_cur = _ctx->seq;
+	if (ret != 0)
+		search_cache_prefetch(ctx);
 	return ret != 0;
 }
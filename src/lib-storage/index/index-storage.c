@@ -280,6 +280,8 @@ int index_storage_mailbox_alloc_index(struct mailbox *box)
 		.index = {
 			.rewrite_min_log_bytes = set->mail_index_rewrite_min_log_bytes,
 			.rewrite_max_log_bytes = set->mail_index_rewrite_max_log_bytes,
+			.rewrite_log_index_size_percentage =
+				set->mail_index_rewrite_log_index_size_percentage,
 		},
 		.log = {
 			.min_size = set->mail_index_log_rotate_min_size,
@@ -380,6 +382,10 @@ int index_storage_mailbox_open(struct mailbox *box, bool move_to_memory)
 	box->mail_vsize_ext_id = mail_index_ext_register(box->index, "vsize", 0,
 							 sizeof(uint32_t),
 							 sizeof(uint32_t));
+	box->mail_dates_ext_id =
+		mail_index_ext_register(box->index, "dates", 0,
+					sizeof(struct index_mail_dates),
+					sizeof(uint32_t));
 
 	box->opened = TRUE;
 
@@ -444,6 +444,7 @@ struct mailbox {
 	uint32_t box_name_hdr_ext_id;
 	uint32_t box_last_rename_stamp_ext_id;
 	uint32_t mail_vsize_ext_id;
+	uint32_t mail_dates_ext_id;
 
 	/* MAIL_RECENT flags handling */
 	ARRAY_TYPE(seq_range) recent_flags;
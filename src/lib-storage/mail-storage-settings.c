@@ -59,6 +59,7 @@ static const struct setting_define mail_storage_setting_defines[] = {
 	DEF(UINT_HIDDEN, mail_cache_purge_header_continue_count),
 	DEF(SIZE_HIDDEN, mail_index_rewrite_min_log_bytes),
 	DEF(SIZE_HIDDEN, mail_index_rewrite_max_log_bytes),
+	DEF(UINT_HIDDEN, mail_index_rewrite_log_index_size_percentage),
 	DEF(SIZE_HIDDEN, mail_index_log_rotate_min_size),
 	DEF(SIZE_HIDDEN, mail_index_log_rotate_max_size),
 	DEF(TIME_HIDDEN, mail_index_log_rotate_min_age),
@@ -133,6 +134,7 @@ const struct mail_storage_settings mail_storage_default_settings = {
 	.mail_cache_purge_header_continue_count = 4,
 	.mail_index_rewrite_min_log_bytes = 8 * 1024,
 	.mail_index_rewrite_max_log_bytes = 128 * 1024,
+	.mail_index_rewrite_log_index_size_percentage = 6,
 	.mail_index_log_rotate_min_size = 32 * 1024,
 	.mail_index_log_rotate_max_size = 1024 * 1024,
 	.mail_index_log_rotate_min_age = 5 * 60,
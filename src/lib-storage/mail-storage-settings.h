@@ -50,6 +50,7 @@ struct mail_storage_settings {
 	unsigned int mail_cache_purge_header_continue_count;
 	uoff_t mail_index_rewrite_min_log_bytes;
 	uoff_t mail_index_rewrite_max_log_bytes;
+	unsigned int mail_index_rewrite_log_index_size_percentage;
 	uoff_t mail_index_log_rotate_min_size;
 	uoff_t mail_index_log_rotate_max_size;
 	unsigned int mail_index_log_rotate_min_age;
@@ -0,0 +1,156 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "test-common.h"
+#include "istream-private.h"
+#include "str.h"
+#include "master-service.h"
+#include "test-mail-storage-common.h"
+#include "imap-msgpart.h"
+
+static void test_imap_msgpart_save(struct mailbox *box, const void *data,
+				   size_t size)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail_save_context *save_ctx;
+	struct istream *input;
+	int ret;
+
+	input = i_stream_create_from_data(data, size);
+	trans = mailbox_transaction_begin(box,
+			MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
+	save_ctx = mailbox_save_alloc(trans);
+	test_assert(mailbox_save_begin(&save_ctx, input) == 0);
+	do {
+		test_assert(mailbox_save_continue(save_ctx) == 0);
+	} while ((ret = i_stream_read(input)) > 0);
+	test_assert(ret == -1 && input->stream_errno == 0);
+	test_assert(mailbox_save_finish(&save_ctx) == 0);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	i_stream_unref(&input);
+	test_assert(mailbox_sync(box, 0) == 0);
+}
+
+static void test_imap_msgpart_cache_parts(struct mailbox *box, uint32_t seq)
+{
+	struct mailbox_transaction_context *trans;
+	struct message_part *parts;
+	struct mail *mail;
+	uoff_t size;
+
+	/* cache also the sizes, so opening the mail doesn't need to look up
+	   the message parts */
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	mail = mail_alloc(trans, MAIL_FETCH_MESSAGE_PARTS |
+			  MAIL_FETCH_VIRTUAL_SIZE | MAIL_FETCH_PHYSICAL_SIZE,
+			  NULL);
+	mail_set_seq(mail, seq);
+	test_assert(mail_get_parts(mail, &parts) == 0);
+	test_assert(mail_get_virtual_size(mail, &size) == 0);
+	test_assert(mail_get_physical_size(mail, &size) == 0);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+}
+
+static unsigned int test_istream_get_depth(struct istream *input)
+{
+	unsigned int depth = 0;
+
+	for (; input != NULL; input = input->real_stream->parent)
+		depth++;
+	return depth;
+}
+
+static const char *
+test_imap_msgpart_read(struct mailbox *box, uint32_t seq,
+		       unsigned int *depth_r)
+{
+	struct mailbox_transaction_context *trans;
+	struct imap_msgpart *msgpart = imap_msgpart_full();
+	struct imap_msgpart_open_result result;
+	struct mail *mail;
+	const unsigned char *data;
+	size_t size;
+	string_t *str = t_str_new(64);
+
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	/* no wanted fields, so the NUL state isn't looked up from the cache
+	   flags when setting the seq */
+	mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, seq);
+	test_assert(!mail->has_nuls && !mail->has_no_nuls);
+	test_assert(imap_msgpart_open(mail, msgpart, &result) == 0);
+	/* the NUL state was found from the cached message parts */
+	test_assert(mail->has_nuls != mail->has_no_nuls);
+	*depth_r = test_istream_get_depth(result.input);
+	while (i_stream_read_more(result.input, &data, &size) > 0) {
+		str_append_data(str, data, size);
+		i_stream_skip(result.input, size);
+	}
+	test_assert(result.input->stream_errno == 0);
+	i_stream_unref(&result.input);
+	imap_msgpart_free(&msgpart);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	return str_c(str);
+}
+
+static void test_imap_msgpart_nonuls(void)
+{
+	static const char mail_no_nuls[] =
+		"Subject: no nuls\r\n\r\nbody\r\n";
+	static const char mail_nuls[] =
+		"Subject: nuls\r\n\r\nbo\0dy\r\n";
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	unsigned int no_nuls_depth, nuls_depth;
+
+	test_begin("imap msgpart nonuls istream");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_imap_msgpart_save(box, mail_no_nuls, sizeof(mail_no_nuls) - 1);
+	test_imap_msgpart_save(box, mail_nuls, sizeof(mail_nuls) - 1);
+	test_imap_msgpart_cache_parts(box, 1);
+	test_imap_msgpart_cache_parts(box, 2);
+
+	/* the cached message parts tell that there are no NULs */
+	test_assert_strcmp(test_imap_msgpart_read(box, 1, &no_nuls_depth),
+			   mail_no_nuls);
+	/* NULs are still replaced, which requires the nonuls istream on top
+	   of the same istream chain */
+	test_assert_strcmp(test_imap_msgpart_read(box, 2, &nuls_depth),
+			   "Subject: nuls\r\n\r\nbo\x80" "dy\r\n");
+	test_assert(no_nuls_depth + 1 == nuls_depth);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+int main(int argc, char **argv)
+{
+	void (*const tests[])(void) = {
+		test_imap_msgpart_nonuls,
+		NULL
+	};
+	int ret;
+
+	master_service = master_service_init("test-imap-msgpart",
+					     MASTER_SERVICE_FLAG_STANDALONE |
+					     MASTER_SERVICE_FLAG_DONT_SEND_STATS |
+					     MASTER_SERVICE_FLAG_CONFIG_BUILTIN |
+					     MASTER_SERVICE_FLAG_NO_SSL_INIT |
+					     MASTER_SERVICE_FLAG_NO_INIT_DATASTACK_FRAME,
+					     &argc, &argv, "");
+	ret = test_run(tests);
+	master_service_deinit(&master_service);
+	return ret;
+}
@@ -3,20 +3,26 @@
 #include "lib.h"
 #include "test-common.h"
 #include "istream.h"
+#include "str.h"
 #include "master-service.h"
 #include "message-size.h"
+#include "mail-index-modseq.h"
+#include "mail-cache-private.h"
+#include "mail-search-build.h"
 #include "test-mail-storage-common.h"
 
 static struct event *test_event;
 
 static int
 test_mail_save_trans(struct mailbox_transaction_context *trans,
-		     struct istream *input)
+		     struct istream *input, time_t received_date)
 {
 	struct mail_save_context *save_ctx;
 	int ret;
 
 	save_ctx = mailbox_save_alloc(trans);
+	if (received_date != (time_t)-1)
+		mailbox_save_set_received_date(save_ctx, received_date, 0);
 	if (mailbox_save_begin(&save_ctx, input) < 0)
 		return -1;
 	do {
@@ -31,7 +37,8 @@ test_mail_save_trans(struct mailbox_transaction_context *trans,
 	return mailbox_save_finish(&save_ctx);
 }
 
-static void test_mail_save(struct mailbox *box, const char *mail_input)
+static void test_mail_save_full(struct mailbox *box, time_t received_date,
+			       const char *mail_input)
 {
 	struct mailbox_transaction_context *trans;
 	struct istream *input;
@@ -40,7 +47,7 @@ static void test_mail_save(struct mailbox *box, const char *mail_input)
 	input = i_stream_create_from_data(mail_input, strlen(mail_input));
 	trans = mailbox_transaction_begin(box,
 			MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
-	ret = test_mail_save_trans(trans, input);
+	ret = test_mail_save_trans(trans, input, received_date);
 	i_stream_unref(&input);
 	if (ret < 0)
 		mailbox_transaction_rollback(&trans);
@@ -55,6 +62,11 @@ static void test_mail_save(struct mailbox *box, const char *mail_input)
 			mailbox_get_last_internal_error(box, NULL));
 }
 
+static void test_mail_save(struct mailbox *box, const char *mail_input)
+{
+	test_mail_save_full(box, (time_t)-1, mail_input);
+}
+
 static void test_mail_remove_keywords(struct mailbox *box)
 {
 	struct mailbox_transaction_context *trans;
@@ -726,6 +738,489 @@ static void test_mail_get_last_internal_error(void)
 	test_mail_storage_deinit(&ctx);
 }
 
+static unsigned int test_mail_search_body(struct mailbox *box, const char *key)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail_search_args *args;
+	struct mail_search_context *search_ctx;
+	struct mail_search_arg *arg;
+	struct mail *mail;
+	unsigned int count = 0;
+
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_BODY);
+	arg->value.str = p_strdup(args->pool, key);
+
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	search_ctx = mailbox_search_init(trans, args, NULL, 0, NULL);
+	while (mailbox_search_next(search_ctx, &mail))
+		count++;
+	test_assert(mailbox_search_deinit(&search_ctx) == 0);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	mail_search_args_unref(&args);
+	return count;
+}
+
+static const char *test_mail_search_cache_file(struct mailbox *box)
+{
+	struct istream *input;
+	const unsigned char *data;
+	size_t size;
+	string_t *str = t_str_new(128);
+
+	input = i_stream_create_file(t_strconcat(box->index->filepath,
+						 ".search", NULL), SIZE_MAX);
+	while (i_stream_read_more(input, &data, &size) > 0) {
+		str_append_data(str, data, size);
+		i_stream_skip(input, size);
+	}
+	test_assert(input->stream_errno == 0 ||
+		    input->stream_errno == ENOENT);
+	i_stream_unref(&input);
+	return str_c(str);
+}
+
+static void test_mail_search_cache(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+
+	test_begin("mail search cache");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	test_mail_save(box, "Subject: 1\r\n\r\nfoo\n");
+	test_mail_save(box, "Subject: 2\r\n\r\nbar\n");
+	test_mail_save(box, "Subject: 3\r\n\r\nfoo\n");
+
+	/* searching doesn't enable modseq tracking */
+	test_assert(test_mail_search_body(box, "foo") == 2);
+	test_assert(!mail_index_have_modseq_tracking(box->index));
+	test_assert_strcmp(test_mail_search_cache_file(box), "");
+
+	test_assert(mailbox_enable(box, MAILBOX_FEATURE_CONDSTORE) == 0);
+	uint64_t modseq = mail_index_modseq_get_highest(box->view);
+	test_assert(test_mail_search_body(box, "foo") == 2);
+	/* the search query is stored only as a hash */
+	const char *cache = test_mail_search_cache_file(box);
+	test_assert(strstr(cache, t_strdup_printf(
+		"\n%"PRIu64"\t", modseq)) != NULL);
+	test_assert(strstr(cache, "\t1,3\n") != NULL);
+	test_assert(strstr(cache, "foo") == NULL);
+	/* cached result is used */
+	test_assert(test_mail_search_body(box, "foo") == 2);
+	test_assert(test_mail_search_body(box, "bar") == 1);
+
+	/* new mails are searched in addition to the cached results */
+	test_mail_save(box, "Subject: 4\r\n\r\nfoo\n");
+	test_assert(test_mail_search_body(box, "foo") == 3);
+	test_assert(strstr(test_mail_search_cache_file(box),
+			   "\t1,3:4\n") != NULL);
+	test_assert(test_mail_search_body(box, "bar") == 1);
+	test_assert(strstr(test_mail_search_cache_file(box),
+			   "\t2\n") != NULL);
+
+	/* the cache isn't written to the index */
+	uint32_t ext_id;
+	test_assert(!mail_index_ext_lookup(box->index, "search-cache",
+					   &ext_id));
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+struct test_cache_compression_box {
+	struct mailbox *box;
+	void (*close)(struct mailbox *box);
+	unsigned int decompress_count;
+};
+static struct test_cache_compression_box test_cache_compression_boxes[2];
+
+/* Run-length encoding: (count, byte) pairs */
+static int
+test_cache_compress(void *context ATTR_UNUSED, const void *data, size_t size,
+		    buffer_t *dest, const char **error_r ATTR_UNUSED)
+{
+	const unsigned char *p = data;
+	unsigned char pair[2];
+
+	for (size_t i = 0; i < size; ) {
+		pair[0] = 0;
+		pair[1] = p[i];
+		for (; i < size && p[i] == pair[1] && pair[0] < UINT8_MAX; i++)
+			pair[0]++;
+		buffer_append(dest, pair, sizeof(pair));
+	}
+	return 0;
+}
+
+static int
+test_cache_decompress(void *context, const void *data, size_t size,
+		      buffer_t *dest, const char **error_r)
+{
+	struct test_cache_compression_box *cbox = context;
+	const unsigned char *p = data;
+
+	if (size % 2 != 0) {
+		*error_r = "odd size";
+		return -1;
+	}
+	for (size_t i = 0; i < size; i += 2) {
+		for (unsigned int j = 0; j < p[i]; j++)
+			buffer_append_c(dest, p[i+1]);
+	}
+	cbox->decompress_count++;
+	return 0;
+}
+
+static const struct mail_cache_compression test_cache_compression = {
+	.compress = test_cache_compress,
+	.decompress = test_cache_decompress,
+};
+
+static void test_cache_compression_box_close(struct mailbox *box)
+{
+	for (unsigned int i = 0; i < N_ELEMENTS(test_cache_compression_boxes); i++) {
+		struct test_cache_compression_box *cbox =
+			&test_cache_compression_boxes[i];
+		if (cbox->box == box) {
+			/* unregister the same way as mail-compress plugin */
+			mail_cache_unregister_compression(box->cache, cbox);
+			cbox->close(box);
+			cbox->box = NULL;
+			return;
+		}
+	}
+	i_unreached();
+}
+
+static struct mailbox *
+test_cache_compression_box_open(struct mail_user *user,
+				struct test_cache_compression_box *cbox)
+{
+	struct mailbox *box =
+		mailbox_alloc(user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	i_zero(cbox);
+	cbox->box = box;
+	cbox->close = box->v.close;
+	box->v.close = test_cache_compression_box_close;
+	mail_cache_register_compression(box->cache, &test_cache_compression,
+					cbox, 1);
+	return box;
+}
+
+static void test_mail_cache_compression_two_instances(void)
+{
+	struct test_cache_compression_box *cbox1 =
+		&test_cache_compression_boxes[0];
+	struct test_cache_compression_box *cbox2 =
+		&test_cache_compression_boxes[1];
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mail_cache_field field = {
+		.name = "test-compressed",
+		.type = MAIL_CACHE_FIELD_VARIABLE_SIZE,
+		.decision = MAIL_CACHE_DECISION_YES,
+	};
+	struct mail_index_transaction *trans;
+	struct mail_cache_view *cache_view;
+	struct mail_cache_transaction_ctx *cache_trans;
+	string_t *str = t_str_new(32);
+
+	test_begin("mail cache compression with two mailbox instances");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box1 =
+		test_cache_compression_box_open(ctx->user, cbox1);
+	struct mailbox *box2 =
+		test_cache_compression_box_open(ctx->user, cbox2);
+	test_assert(box1->cache == box2->cache);
+	test_mail_save(box1, "Subject: 1\r\n\r\nbody\n");
+
+	mail_cache_register_fields(box1->cache, &field, 1,
+				   unsafe_data_stack_pool);
+	cache_view = mail_cache_view_open(box1->cache, box1->view);
+	trans = mail_index_transaction_begin(box1->view, 0);
+	cache_trans = mail_cache_get_transaction(cache_view, trans);
+	mail_cache_add(cache_trans, 1, field.idx, "aaaaaaaaaaaaaaaa", 16);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_cache_view_close(&cache_view);
+	test_assert(mailbox_sync(box1, 0) == 0);
+
+	/* closing one instance keeps the other one's registration */
+	mailbox_free(&box2);
+	test_assert(box1->cache->compression_context == cbox1);
+	cache_view = mail_cache_view_open(box1->cache, box1->view);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1, field.idx) == 1);
+	test_assert_strcmp(str_c(str), "aaaaaaaaaaaaaaaa");
+	test_assert(cbox1->decompress_count == 1);
+	test_assert(cbox2->decompress_count == 0);
+	mail_cache_view_close(&cache_view);
+
+	/* the last instance's close unregisters it */
+	struct mail_cache *cache = box1->cache;
+	mailbox_free(&box1);
+	test_assert(cache->compression == NULL);
+	test_assert(array_count(&cache->compression_registrations) == 0);
+
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static const char *
+test_mail_search_uids(struct mailbox *box, struct mail_search_args *args)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail_search_context *search_ctx;
+	struct mail *mail;
+	string_t *str = t_str_new(32);
+
+	mail_search_args_init(args, box, FALSE, NULL);
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	search_ctx = mailbox_search_init(trans, args, NULL, 0, NULL);
+	while (mailbox_search_next(search_ctx, &mail))
+		str_printfa(str, "%u ", mail->uid);
+	test_assert(mailbox_search_deinit(&search_ctx) == 0);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	mail_search_args_deinit(args);
+	return str_c(str);
+}
+
+static void test_mail_search_flags(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mail_search_args *args;
+	struct mail_search_arg *arg;
+	struct mail_keywords *kw;
+	const char *const keywords[] = { "$foo", NULL };
+
+	test_begin("mail search flags and keywords");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	for (unsigned int i = 1; i <= 6; i++)
+		test_mail_save(box, t_strdup_printf("Subject: %u\r\n\r\n", i));
+
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	kw = mailbox_keywords_create_valid(box, keywords);
+	mail_set_seq(mail, 2);
+	mail_update_flags(mail, MODIFY_ADD, MAIL_SEEN | MAIL_FLAGGED);
+	mail_update_keywords(mail, MODIFY_ADD, kw);
+	mail_set_seq(mail, 3);
+	mail_update_flags(mail, MODIFY_ADD, MAIL_SEEN);
+	mail_set_seq(mail, 5);
+	mail_update_flags(mail, MODIFY_ADD, MAIL_FLAGGED);
+	mail_update_keywords(mail, MODIFY_ADD, kw);
+	mailbox_keywords_unref(&kw);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+
+	/* UNSEEN */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_FLAGS);
+	arg->value.flags = MAIL_SEEN;
+	arg->match_not = TRUE;
+	test_assert_strcmp(test_mail_search_uids(box, args), "1 4 5 6 ");
+	mail_search_args_unref(&args);
+
+	/* FLAGGED UNSEEN */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_FLAGS);
+	arg->value.flags = MAIL_FLAGGED;
+	arg = mail_search_build_add(args, SEARCH_FLAGS);
+	arg->value.flags = MAIL_SEEN;
+	arg->match_not = TRUE;
+	test_assert_strcmp(test_mail_search_uids(box, args), "5 ");
+	mail_search_args_unref(&args);
+
+	/* KEYWORD $foo SEEN */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_KEYWORDS);
+	arg->value.str = "$foo";
+	arg = mail_search_build_add(args, SEARCH_FLAGS);
+	arg->value.flags = MAIL_SEEN;
+	test_assert_strcmp(test_mail_search_uids(box, args), "2 ");
+	mail_search_args_unref(&args);
+
+	/* UNKEYWORD $foo */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_KEYWORDS);
+	arg->value.str = "$foo";
+	arg->match_not = TRUE;
+	test_assert_strcmp(test_mail_search_uids(box, args), "1 3 4 6 ");
+	mail_search_args_unref(&args);
+
+	/* KEYWORD $nonexistent */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_KEYWORDS);
+	arg->value.str = "$nonexistent";
+	test_assert_strcmp(test_mail_search_uids(box, args), "");
+	mail_search_args_unref(&args);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_mail_search_flags_chunks(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mail_search_args *args;
+	struct mail_search_arg *arg;
+	const unsigned int count = 2500;
+
+	test_begin("mail search flags in multiple chunks");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	struct mailbox_transaction_context *trans =
+		mailbox_transaction_begin(box,
+			MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
+	for (unsigned int i = 1; i <= count; i++) {
+		struct istream *input = i_stream_create_from_data("\r\n", 2);
+		test_assert(test_mail_save_trans(trans, input, (time_t)-1) == 0);
+		i_stream_unref(&input);
+	}
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+
+	/* the matches are in the first and the last chunks, with nothing
+	   matching in between */
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	struct mail *mail = mail_alloc(trans, 0, NULL);
+	mail_set_seq(mail, 3);
+	mail_update_flags(mail, MODIFY_ADD, MAIL_FLAGGED);
+	mail_set_seq(mail, count);
+	mail_update_flags(mail, MODIFY_ADD, MAIL_FLAGGED);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&trans) == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_FLAGS);
+	arg->value.flags = MAIL_FLAGGED;
+	test_assert_strcmp(test_mail_search_uids(box, args),
+			   t_strdup_printf("3 %u ", count));
+	mail_search_args_unref(&args);
+
+	/* UNFLAGGED with a sequence range crossing a chunk boundary */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_FLAGS);
+	arg->value.flags = MAIL_FLAGGED;
+	arg->match_not = TRUE;
+	arg = mail_search_build_add(args, SEARCH_UIDSET);
+	p_array_init(&arg->value.seqset, args->pool, 1);
+	seq_range_array_add_range(&arg->value.seqset, 1022, 1026);
+	test_assert_strcmp(test_mail_search_uids(box, args),
+			   "1022 1023 1024 1025 1026 ");
+	mail_search_args_unref(&args);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_mail_search_dates(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+	struct mail_search_args *args;
+	struct mail_search_arg *arg;
+	const void *data;
+	uint32_t ext_id;
+	bool expunged;
+
+	test_begin("mail search dates");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	/* 2020-01-10 12:00, 2021-01-10 12:00, 2022-01-10 12:00 UTC */
+	test_mail_save_full(box, 1578657600,
+		"Date: Mon, 10 Jan 2022 12:00:00 +0000\r\n\r\n");
+	test_mail_save_full(box, 1610280000,
+		"Date: Sun, 10 Jan 2021 12:00:00 +0000\r\n\r\n");
+	test_mail_save_full(box, 1641816000,
+		"Date: Fri, 10 Jan 2020 12:00:00 +0000\r\n\r\n");
+
+	/* the dates were added to the index while saving */
+	test_assert(mail_index_ext_lookup(box->index, "dates", &ext_id));
+	mail_index_lookup_ext(box->view, 2, ext_id, &data, &expunged);
+	test_assert(data != NULL &&
+		    ((const uint32_t *)data)[0] == 1610280000 &&
+		    ((const uint32_t *)data)[1] == 1610280000);
+
+	/* SINCE 1-Jun-2020 */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_SINCE);
+	arg->value.date_type = MAIL_SEARCH_DATE_TYPE_RECEIVED;
+	arg->value.time = 1590969600;
+	test_assert_strcmp(test_mail_search_uids(box, args), "2 3 ");
+	mail_search_args_unref(&args);
+
+	/* SENTBEFORE 1-Jun-2020 */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_BEFORE);
+	arg->value.date_type = MAIL_SEARCH_DATE_TYPE_SENT;
+	arg->value.time = 1590969600;
+	test_assert_strcmp(test_mail_search_uids(box, args), "3 ");
+	mail_search_args_unref(&args);
+
+	/* SENTON 10-Jan-2021 NOT SINCE 1-Jan-2021 */
+	args = mail_search_build_init();
+	arg = mail_search_build_add(args, SEARCH_ON);
+	arg->value.date_type = MAIL_SEARCH_DATE_TYPE_SENT;
+	arg->value.time = 1610236800;
+	arg = mail_search_build_add(args, SEARCH_SINCE);
+	arg->value.date_type = MAIL_SEARCH_DATE_TYPE_RECEIVED;
+	arg->value.time = 1609459200;
+	arg->match_not = TRUE;
+	test_assert_strcmp(test_mail_search_uids(box, args), "");
+	mail_search_args_unref(&args);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
 int main(int argc, char **argv)
 {
 	void (*const tests[])(void) = {
@@ -736,6 +1231,11 @@ int main(int argc, char **argv)
 		test_mail_set_critical,
 		test_mail_set_critical_different_mailboxes,
 		test_mail_get_last_internal_error,
+		test_mail_search_cache,
+		test_mail_cache_compression_two_instances,
+		test_mail_search_flags,
+		test_mail_search_flags_chunks,
+		test_mail_search_dates,
 		NULL
 	};
 	int ret;
@@ -0,0 +1,90 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "crc32.h"
+#include "hash.h"
+#include "randgen.h"
+#include "strnum.h"
+#include "time-util.h"
+
+#include <stdio.h>
+
+/**
+ * Measures how long the CRC32 and hash functions take to process random
+ * data in blocks of given size.
+ */
+
+static unsigned int bench_crc32(const unsigned char *data, size_t size)
+{
+	return crc32_data(data, size);
+}
+
+static unsigned int bench_mem_hash(const unsigned char *data, size_t size)
+{
+	return mem_hash(data, size);
+}
+
+static unsigned int bench_str_hash(const unsigned char *data,
+				   size_t size ATTR_UNUSED)
+{
+	return str_hash((const char *)data);
+}
+
+static const struct {
+	const char *name;
+	unsigned int (*func)(const unsigned char *data, size_t size);
+} bench_funcs[] = {
+	{ "crc32_data", bench_crc32 },
+	{ "mem_hash", bench_mem_hash },
+	{ "str_hash", bench_str_hash },
+};
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [<block_size> [<count>]]\n", prog);
+	fprintf(stderr, "Runs with 100000 64 byte blocks if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	lib_init();
+
+	unsigned long block_size = 64UL;
+	unsigned long block_count = 100000UL;
+
+	if (argc >= 2 && str_to_ulong(argv[1], &block_size) < 0) {
+		fprintf(stderr, "Invalid parameters\n");
+		print_usage(argv[0]);
+	}
+	if (argc >= 3 && str_to_ulong(argv[2], &block_count) < 0) {
+		fprintf(stderr, "Invalid parameters\n");
+		print_usage(argv[0]);
+	}
+	if (argc > 3 || block_size == 0)
+		print_usage(argv[0]);
+
+	/* str_hash() needs NUL-terminated input without NULs in the middle */
+	unsigned char *data = i_malloc(block_size + 1);
+	for (size_t i = 0; i < block_size; i++)
+		data[i] = i_rand_minmax(1, 255);
+
+	printf("Input data is %lu blocks of %lu bytes\n\n",
+	       block_count, block_size);
+	for (unsigned int i = 0; i < N_ELEMENTS(bench_funcs); i++) {
+		unsigned int result = 0;
+		uint64_t ts_0 = i_nanoseconds();
+		for (unsigned long r = 0; r < block_count; r++) {
+			/* modify the data so the calls can't be optimized away */
+			data[r % block_size] = 'a' + r % 26;
+			result ^= bench_funcs[i].func(data, block_size);
+		}
+		uint64_t ts_1 = i_nanoseconds();
+		double speed = ((double)(ts_1 - ts_0))/((double)block_count);
+
+		printf("%s\n\t%0.02lf ns/block (result %u)\n",
+		       bench_funcs[i].name, speed, result);
+	}
+	i_free(data);
+	lib_deinit();
+}
@@ -1,8 +1,13 @@
 /* Copyright (c) 2006-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "byteorder.h"
 #include "crc32.h"
 
+#ifdef __ARM_FEATURE_CRC32
+#  include <arm_acle.h>
+#endif
+
 static uint32_t crc32tab[256] = {
 	0x00000000,
 	0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
@@ -58,21 +63,72 @@ static uint32_t crc32tab[256] = {
 	0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
 };
 
-uint32_t crc32_data(const void *data, size_t size)
+#ifdef __ARM_FEATURE_CRC32
+/* ARMv8 CRC32 instructions use the same polynomial as crc32tab */
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t size)
 {
-	return crc32_data_more(0, data, size);
+	for (; size >= 8; size -= 8, p += 8)
+		crc = __crc32d(crc, le64_to_cpu_unaligned(p));
+	for (; size > 0; size--, p++)
+		crc = __crc32b(crc, *p);
+	return crc;
 }
+#else
+/* crc32tab_slice[n][i] is the CRC of byte i followed by n+1 zero bytes.
+   They're used to process 8 bytes at a time ("slicing-by-8"). */
+static uint32_t crc32tab_slice[7][256];
+static bool crc32tab_slice_initialized = FALSE;
 
-uint32_t crc32_data_more(uint32_t crc, const void *data, size_t size)
+static void crc32tab_slice_init(void)
 {
-	const uint8_t *p = data, *end = p + size;
+	unsigned int i, n;
+	uint32_t crc;
 
-	crc ^= 0xffffffff;
-	for (; p != end; p++)
+	for (i = 0; i < 256; i++) {
+		crc = crc32tab[i];
+		for (n = 0; n < N_ELEMENTS(crc32tab_slice); n++) {
+			crc = (crc >> 8) ^ crc32tab[crc & 0xff];
+			crc32tab_slice[n][i] = crc;
+		}
+	}
+	crc32tab_slice_initialized = TRUE;
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t size)
+{
+	uint32_t lo, hi;
+
+	if (size >= 16) {
+		if (unlikely(!crc32tab_slice_initialized))
+			crc32tab_slice_init();
+		for (; size >= 8; size -= 8, p += 8) {
+			lo = le32_to_cpu_unaligned(p) ^ crc;
+			hi = le32_to_cpu_unaligned(p + 4);
+			crc = crc32tab_slice[6][lo & 0xff] ^
+				crc32tab_slice[5][(lo >> 8) & 0xff] ^
+				crc32tab_slice[4][(lo >> 16) & 0xff] ^
+				crc32tab_slice[3][lo >> 24] ^
+				crc32tab_slice[2][hi & 0xff] ^
+				crc32tab_slice[1][(hi >> 8) & 0xff] ^
+				crc32tab_slice[0][(hi >> 16) & 0xff] ^
+				crc32tab[hi >> 24];
+		}
+	}
+	for (; size > 0; size--, p++)
 		crc = (crc >> 8) ^ crc32tab[((crc ^ *p) & 0xff)];
-	crc ^= 0xffffffff;
 	return crc;
 }
+#endif
+
+uint32_t crc32_data(const void *data, size_t size)
+{
+	return crc32_data_more(0, data, size);
+}
+
+uint32_t crc32_data_more(uint32_t crc, const void *data, size_t size)
+{
+	return crc32_update(crc ^ 0xffffffff, data, size) ^ 0xffffffff;
+}
 
 uint32_t crc32_str(const char *str)
 {
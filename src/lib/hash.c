@@ -3,12 +3,23 @@
 /* @UNSAFE: whole file */
 
 #include "lib.h"
+#include "byteorder.h"
 #include "hash.h"
-#include "primes.h"
+#include "bits.h"
 
 #include <ctype.h>
 
-#define HASH_TABLE_MIN_SIZE 67
+/* The table is an open addressing hash table with linear probing. The size is
+   always a power of 2. */
+#define HASH_TABLE_MIN_SIZE 64
+/* Grow the table when more than 3/4 of the entries are used (including the
+   removed entries). */
+#define HASH_TABLE_MAX_LOAD(size) ((size) / 4 * 3)
+/* Shrink the table when less than 1/8 of the entries are used */
+#define HASH_TABLE_MIN_LOAD(size) ((size) / 8)
+/* The table can't be resized while it's frozen. Once it's this full, add
+   the new nodes to the overflow list instead. */
+#define HASH_TABLE_MAX_FROZEN_LOAD(size) ((size) - (size) / 16)
 
 #undef hash_table_create
 #undef hash_table_create_direct
@@ -26,20 +37,34 @@
 #undef hash_table_thaw
 #undef hash_table_copy
 
-struct hash_node {
-	struct hash_node *next;
+struct hash_entry {
+	/* NULL if the entry is unused */
 	void *key;
 	void *value;
+	unsigned int hash;
+	/* The entry was removed. Lookups must continue probing past it. */
+	bool removed;
+};
+
+struct hash_node {
+	struct hash_entry entry;
+	struct hash_node *next;
 };
 
 struct hash_table {
 	pool_t node_pool;
 
 	int frozen;
-	unsigned int initial_size, nodes_count, removed_count;
-
-	unsigned int size;
-	struct hash_node *nodes;
+	/* nodes_count is the number of keys in the table, including the
+	   overflow list. used_count is the number of entries[] that have a
+	   key or are marked as removed. */
+	unsigned int initial_size, nodes_count, used_count;
+
+	unsigned int size, size_bits;
+	struct hash_entry *entries;
+	/* Nodes that were inserted while the table was frozen and too full.
+	   They are moved to entries[] when the table is thawed. */
+	struct hash_node *overflow_nodes;
 	struct hash_node *free_nodes;
 
 	hash_callback_t *hash_cb;
@@ -48,17 +73,41 @@ struct hash_table {
 
 struct hash_iterate_context {
 	struct hash_table *table;
-	struct hash_node *next;
 	unsigned int pos;
+	struct hash_node *next_node;
+	bool iterating_overflow;
 };
 
-enum hash_table_operation{
-	HASH_TABLE_OP_INSERT,
-	HASH_TABLE_OP_UPDATE,
-	HASH_TABLE_OP_RESIZE
-};
+static void hash_table_check_resize(struct hash_table *table);
+
+static unsigned int hash_table_get_wanted_size(unsigned int count)
+{
+	/* keep the table at most half full after resizing */
+	if (count > UINT_MAX / 4)
+		i_panic("hash table too large");
+	return I_MAX(nearest_power(count * 2), HASH_TABLE_MIN_SIZE);
+}
 
-static bool hash_table_resize(struct hash_table *table, bool grow);
+static void
+hash_table_alloc_entries(struct hash_table *table, unsigned int size)
+{
+	i_assert(size >= HASH_TABLE_MIN_SIZE && (size & (size - 1)) == 0);
+
+	table->size = size;
+	table->size_bits = bits_required32(size) - 1;
+	table->entries = i_new(struct hash_entry, size);
+	table->used_count = 0;
+}
+
+static inline unsigned int
+hash_table_get_pos(const struct hash_table *table, unsigned int hash)
+{
+	/* Multiplicative hashing: the hash callbacks often return values
+	   where the low bits are poorly distributed (e.g. pointers), so use
+	   the high bits of the product. */
+	return (unsigned int)(((uint32_t)hash * 0x9e3779b9U) >>
+			      (32 - table->size_bits));
+}
 
 void hash_table_create(struct hash_table **table_r, pool_t node_pool,
 		       unsigned int initial_size, hash_callback_t *hash_cb,
@@ -69,14 +118,12 @@ void hash_table_create(struct hash_table **table_r, pool_t node_pool,
 	pool_ref(node_pool);
 	table = i_new(struct hash_table, 1);
 	table->node_pool = node_pool;
-	table->initial_size =
-		I_MAX(primes_closest(initial_size), HASH_TABLE_MIN_SIZE);
+	table->initial_size = hash_table_get_wanted_size(initial_size);
 
 	table->hash_cb = hash_cb;
 	table->key_compare_cb = key_compare_cb;
 
-	table->size = table->initial_size;
-	table->nodes = i_new(struct hash_node, table->size);
+	hash_table_alloc_entries(table, table->initial_size);
 	*table_r = table;
 }
 
@@ -119,16 +166,6 @@ static void destroy_node_list(struct hash_table *table, struct hash_node *node)
 	}
 }
 
-static void hash_table_destroy_nodes(struct hash_table *table)
-{
-	unsigned int i;
-
-	for (i = 0; i < table->size; i++) {
-		if (table->nodes[i].next != NULL)
-			destroy_node_list(table, table->nodes[i].next);
-	}
-}
-
 void hash_table_destroy(struct hash_table **_table)
 {
 	struct hash_table *table = *_table;
@@ -138,23 +175,20 @@ void hash_table_destroy(struct hash_table **_table)
 	*_table = NULL;
 
 	i_assert(table->frozen == 0);
+	i_assert(table->overflow_nodes == NULL);
 
-	if (!table->node_pool->alloconly_pool) {
-		hash_table_destroy_nodes(table);
+	if (!table->node_pool->alloconly_pool)
 		destroy_node_list(table, table->free_nodes);
-	}
 
 	pool_unref(&table->node_pool);
-	i_free(table->nodes);
+	i_free(table->entries);
 	i_free(table);
 }
 
 void hash_table_clear(struct hash_table *table, bool free_nodes)
 {
 	i_assert(table->frozen == 0);
-
-	if (!table->node_pool->alloconly_pool)
-		hash_table_destroy_nodes(table);
+	i_assert(table->overflow_nodes == NULL);
 
 	if (free_nodes) {
 		if (!table->node_pool->alloconly_pool)
@@ -162,204 +196,200 @@ void hash_table_clear(struct hash_table *table, bool free_nodes)
 		table->free_nodes = NULL;
 	}
 
-	memset(table->nodes, 0, sizeof(struct hash_node) * table->size);
+	memset(table->entries, 0, sizeof(struct hash_entry) * table->size);
 
 	table->nodes_count = 0;
-	table->removed_count = 0;
+	table->used_count = 0;
 }
 
-static struct hash_node *
-hash_table_lookup_node(const struct hash_table *table,
-		       const void *key, unsigned int hash)
+static struct hash_entry *
+hash_table_lookup_overflow(const struct hash_table *table,
+			   const void *key, unsigned int hash)
 {
 	struct hash_node *node;
 
-	node = &table->nodes[hash % table->size];
+	for (node = table->overflow_nodes; node != NULL; node = node->next) {
+		if (node->entry.key != NULL && node->entry.hash == hash &&
+		    table->key_compare_cb(node->entry.key, key) == 0)
+			return &node->entry;
+	}
+	return NULL;
+}
 
-	do {
-		if (node->key != NULL) {
-			if (table->key_compare_cb(node->key, key) == 0)
-				return node;
+/* Returns the entry with the given key, or NULL if not found. If free_r is
+   non-NULL, it's set to the first free entry where the key could be
+   inserted. */
+static struct hash_entry *
+hash_table_lookup_entry(const struct hash_table *table,
+			const void *key, unsigned int hash,
+			struct hash_entry **free_r)
+{
+	unsigned int mask = table->size - 1;
+	unsigned int pos = hash_table_get_pos(table, hash);
+	struct hash_entry *entry, *free_entry = NULL;
+
+	/* there's always at least one unused entry, so this finishes */
+	for (;; pos = (pos + 1) & mask) {
+		entry = &table->entries[pos];
+		if (entry->key == NULL) {
+			if (free_entry == NULL)
+				free_entry = entry;
+			if (!entry->removed)
+				break;
+		} else if (entry->hash == hash &&
+			   table->key_compare_cb(entry->key, key) == 0) {
+			return entry;
 		}
-		node = node->next;
-	} while (node != NULL);
-
+	}
+	if (free_r != NULL)
+		*free_r = free_entry;
+	if (unlikely(table->overflow_nodes != NULL))
+		return hash_table_lookup_overflow(table, key, hash);
 	return NULL;
 }
 
 void *hash_table_lookup(const struct hash_table *table, const void *key)
 {
-	struct hash_node *node;
+	struct hash_entry *entry;
 
-	node = hash_table_lookup_node(table, key, table->hash_cb(key));
-	return node != NULL ? node->value : NULL;
+	entry = hash_table_lookup_entry(table, key, table->hash_cb(key), NULL);
+	return entry != NULL ? entry->value : NULL;
 }
 
 bool hash_table_lookup_full(const struct hash_table *table,
 			    const void *lookup_key,
 			    void **orig_key, void **value)
 {
-	struct hash_node *node;
+	struct hash_entry *entry;
 
-	node = hash_table_lookup_node(table, lookup_key,
-				      table->hash_cb(lookup_key));
-	if (node == NULL)
+	entry = hash_table_lookup_entry(table, lookup_key,
+					table->hash_cb(lookup_key), NULL);
+	if (entry == NULL)
 		return FALSE;
 
-	*orig_key = node->key;
-	*value = node->value;
+	*orig_key = entry->key;
+	*value = entry->value;
 	return TRUE;
 }
 
 static void
-hash_table_insert_node(struct hash_table *table, void *key, void *value,
-			     enum hash_table_operation opcode)
+hash_table_insert_overflow(struct hash_table *table, void *key, void *value,
+			   unsigned int hash)
 {
-	struct hash_node *node, *prev;
+	struct hash_node *node;
+
+	if (table->free_nodes == NULL)
+		node = p_new(table->node_pool, struct hash_node, 1);
+	else {
+		node = table->free_nodes;
+		table->free_nodes = node->next;
+	}
+	node->entry.key = key;
+	node->entry.value = value;
+	node->entry.hash = hash;
+	node->entry.removed = FALSE;
+	node->next = table->overflow_nodes;
+	table->overflow_nodes = node;
+}
+
+static void
+hash_table_insert_entry(struct hash_table *table, void *key, void *value,
+			bool update)
+{
+	struct hash_entry *entry, *free_entry;
 	unsigned int hash;
-	bool check_existing = TRUE;
 
 	i_assert(table->nodes_count < UINT_MAX);
 	i_assert(key != NULL);
 
-	if(opcode == HASH_TABLE_OP_RESIZE)
-		check_existing = FALSE;
 	hash = table->hash_cb(key);
-
-	if (check_existing && table->removed_count > 0) {
-		/* there may be holes, have to check everything */
-		node = hash_table_lookup_node(table, key, hash);
-		if (node != NULL) {
-			i_assert(opcode == HASH_TABLE_OP_UPDATE);
-			node->value = value;
-			return;
-		}
-
-		check_existing = FALSE;
-	}
-
-	/* a) primary node */
-	node = &table->nodes[hash % table->size];
-	if (node->key == NULL) {
-		table->nodes_count++;
-
-		node->key = key;
-		node->value = value;
+	entry = hash_table_lookup_entry(table, key, hash, &free_entry);
+	if (entry != NULL) {
+		i_assert(update);
+		entry->value = value;
 		return;
 	}
-	if (check_existing) {
-		if (table->key_compare_cb(node->key, key) == 0) {
-			i_assert(opcode == HASH_TABLE_OP_UPDATE);
-			node->value = value;
-			return;
-		}
-	}
-
-	/* b) collisions list */
-	prev = node; node = node->next;
-	while (node != NULL) {
-		if (node->key == NULL)
-			break;
-
-		if (check_existing) {
-			if (table->key_compare_cb(node->key, key) == 0) {
-				i_assert(opcode == HASH_TABLE_OP_UPDATE);
-				node->value = value;
-				return;
-			}
-		}
-		prev = node;
-		node = node->next;
-	}
 
-	if (node == NULL) {
-		if (table->frozen == 0 && hash_table_resize(table, TRUE)) {
-			/* resized table, try again */
-			hash_table_insert_node(table, key, value, HASH_TABLE_OP_RESIZE);
+	if (!free_entry->removed) {
+		/* using a new entry */
+		if (table->frozen == 0 &&
+		    table->used_count + 1 > HASH_TABLE_MAX_LOAD(table->size)) {
+			hash_table_check_resize(table);
+			(void)hash_table_lookup_entry(table, key, hash,
+						      &free_entry);
+		} else if (table->frozen != 0 &&
+			   table->used_count + 1 >
+			   HASH_TABLE_MAX_FROZEN_LOAD(table->size)) {
+			hash_table_insert_overflow(table, key, value, hash);
+			table->nodes_count++;
 			return;
 		}
-
-		if (table->free_nodes == NULL)
-			node = p_new(table->node_pool, struct hash_node, 1);
-		else {
-			node = table->free_nodes;
-			table->free_nodes = node->next;
-			node->next = NULL;
-		}
-		prev->next = node;
 	}
+	if (!free_entry->removed)
+		table->used_count++;
 
-	node->key = key;
-	node->value = value;
-
+	free_entry->key = key;
+	free_entry->value = value;
+	free_entry->hash = hash;
+	free_entry->removed = FALSE;
 	table->nodes_count++;
 }
 
 void hash_table_insert(struct hash_table *table, void *key, void *value)
 {
-	hash_table_insert_node(table, key, value, HASH_TABLE_OP_INSERT);
+	hash_table_insert_entry(table, key, value, FALSE);
 }
 
 void hash_table_update(struct hash_table *table, void *key, void *value)
 {
-	hash_table_insert_node(table, key, value, HASH_TABLE_OP_UPDATE);
+	hash_table_insert_entry(table, key, value, TRUE);
 }
 
 static void
-hash_table_compress(struct hash_table *table, struct hash_node *root)
+hash_table_remove_entry(struct hash_table *table, struct hash_entry *entry)
 {
-	struct hash_node *node, *next;
-
-	i_assert(table->frozen == 0);
-
-	/* remove deleted nodes from the list */
-	for (node = root; node->next != NULL; ) {
-		next = node->next;
-
-		if (next->key == NULL) {
-			node->next = next->next;
-			free_node(table, next);
-		} else {
-			node = next;
-		}
+	unsigned int mask = table->size - 1;
+	unsigned int pos = entry - table->entries;
+
+	entry->key = NULL;
+	entry->value = NULL;
+	if (table->entries[(pos + 1) & mask].key != NULL ||
+	    table->entries[(pos + 1) & mask].removed) {
+		/* there may be keys after this one in the probe sequence */
+		entry->removed = TRUE;
+		return;
 	}
 
-	/* update root */
-	if (root->key == NULL && root->next != NULL) {
-		next = root->next;
-		*root = *next;
-		free_node(table, next);
+	/* The next entry is unused, so this and any removed entries just
+	   before it aren't needed by lookups. Nothing is moved, so this is
+	   safe to do also while iterating. */
+	entry->removed = FALSE;
+	table->used_count--;
+	for (pos = (pos - 1) & mask; table->entries[pos].removed;
+	     pos = (pos - 1) & mask) {
+		table->entries[pos].removed = FALSE;
+		table->used_count--;
 	}
 }
 
-static void hash_table_compress_removed(struct hash_table *table)
-{
-	unsigned int i;
-
-	for (i = 0; i < table->size; i++)
-		hash_table_compress(table, &table->nodes[i]);
-
-	table->removed_count = 0;
-}
-
 bool hash_table_try_remove(struct hash_table *table, const void *key)
 {
-	struct hash_node *node;
-	unsigned int hash;
-
-	hash = table->hash_cb(key);
+	struct hash_entry *entry;
 
-	node = hash_table_lookup_node(table, key, hash);
-	if (unlikely(node == NULL))
+	entry = hash_table_lookup_entry(table, key, table->hash_cb(key), NULL);
+	if (unlikely(entry == NULL))
 		return FALSE;
 
-	node->key = NULL;
+	if (entry >= table->entries && entry < table->entries + table->size)
+		hash_table_remove_entry(table, entry);
+	else {
+		/* in the overflow list - it's freed when thawing */
+		entry->key = NULL;
+	}
 	table->nodes_count--;
 
-	if (table->frozen != 0)
-		table->removed_count++;
-	else if (!hash_table_resize(table, FALSE))
-		hash_table_compress(table, &table->nodes[hash % table->size]);
+	if (table->frozen == 0)
+		hash_table_check_resize(table);
 	return TRUE;
 }
 
@@ -376,44 +406,47 @@ struct hash_iterate_context *hash_table_iterate_init(struct hash_table *table)
 
 	ctx = i_new(struct hash_iterate_context, 1);
 	ctx->table = table;
-	ctx->next = &table->nodes[0];
 	return ctx;
 }
 
-static struct hash_node *
-hash_table_iterate_next(struct hash_iterate_context *ctx,
-			struct hash_node *node)
+static struct hash_entry *
+hash_table_iterate_next(struct hash_iterate_context *ctx)
 {
-	do {
-		node = node->next;
-		if (node == NULL) {
-			if (++ctx->pos == ctx->table->size) {
-				ctx->pos--;
-				return NULL;
-			}
-			node = &ctx->table->nodes[ctx->pos];
-		}
-	} while (node->key == NULL);
+	struct hash_table *table = ctx->table;
+	struct hash_node *node;
 
-	return node;
+	for (; ctx->pos < table->size; ctx->pos++) {
+		if (table->entries[ctx->pos].key != NULL)
+			return &table->entries[ctx->pos++];
+	}
+
+	/* Nodes inserted while iterating may or may not be returned,
+	   so it doesn't matter if new overflow nodes are added before
+	   next_node. */
+	if (!ctx->iterating_overflow) {
+		ctx->iterating_overflow = TRUE;
+		ctx->next_node = table->overflow_nodes;
+	}
+	while ((node = ctx->next_node) != NULL) {
+		ctx->next_node = node->next;
+		if (node->entry.key != NULL)
+			return &node->entry;
+	}
+	return NULL;
 }
 
 bool hash_table_iterate(struct hash_iterate_context *ctx,
 			void **key_r, void **value_r)
 {
-	struct hash_node *node;
+	struct hash_entry *entry;
 
-	node = ctx->next;
-	if (node != NULL && node->key == NULL)
-		node = hash_table_iterate_next(ctx, node);
-	if (node == NULL) {
+	entry = hash_table_iterate_next(ctx);
+	if (entry == NULL) {
 		*key_r = *value_r = NULL;
 		return FALSE;
 	}
-	*key_r = node->key;
-	*value_r = node->value;
-
-	ctx->next = hash_table_iterate_next(ctx, node);
+	*key_r = entry->key;
+	*value_r = entry->value;
 	return TRUE;
 }
 
@@ -441,67 +474,66 @@ void hash_table_thaw(struct hash_table *table)
 	if (--table->frozen > 0)
 		return;
 
-	if (table->removed_count > 0) {
-		if (!hash_table_resize(table, FALSE))
-			hash_table_compress_removed(table);
-	}
+	hash_table_check_resize(table);
 }
 
-static bool hash_table_resize(struct hash_table *table, bool grow)
+static void
+hash_table_resize_insert(struct hash_table *table, const struct hash_entry *src)
 {
-	struct hash_node *old_nodes, *node, *next;
-	unsigned int next_size, old_size, i;
-	float nodes_per_list;
-
-	i_assert(table->frozen == 0);
+	unsigned int mask = table->size - 1;
+	unsigned int pos = hash_table_get_pos(table, src->hash);
 
-	nodes_per_list = (float) table->nodes_count / (float) table->size;
-	if (nodes_per_list > 0.3 && nodes_per_list < 2.0)
-		return FALSE;
+	while (table->entries[pos].key != NULL)
+		pos = (pos + 1) & mask;
+	table->entries[pos] = *src;
+	table->used_count++;
+}
 
-	next_size = I_MAX(primes_closest(table->nodes_count+1),
-			  table->initial_size);
-	if (next_size == table->size)
-		return FALSE;
+static void hash_table_resize(struct hash_table *table, unsigned int new_size)
+{
+	struct hash_entry *old_entries;
+	struct hash_node *node, *next;
+	unsigned int old_size, i;
 
-	if (grow && table->size >= next_size)
-		return FALSE;
+	i_assert(table->frozen == 0);
 
-	/* recreate primary table */
 	old_size = table->size;
-	old_nodes = table->nodes;
-
-	table->size = I_MAX(next_size, HASH_TABLE_MIN_SIZE);
-	table->nodes = i_new(struct hash_node, table->size);
-
-	table->nodes_count = 0;
-	table->removed_count = 0;
-
-	table->frozen++;
+	old_entries = table->entries;
+	hash_table_alloc_entries(table, new_size);
 
 	/* move the data */
 	for (i = 0; i < old_size; i++) {
-		node = &old_nodes[i];
-		if (node->key != NULL) {
-			hash_table_insert_node(table, node->key,
-					       node->value, HASH_TABLE_OP_RESIZE);
-		}
+		if (old_entries[i].key != NULL)
+			hash_table_resize_insert(table, &old_entries[i]);
+	}
+	for (node = table->overflow_nodes; node != NULL; node = next) {
+		next = node->next;
+		if (node->entry.key != NULL)
+			hash_table_resize_insert(table, &node->entry);
+		free_node(table, node);
+	}
+	table->overflow_nodes = NULL;
+	i_assert(table->used_count == table->nodes_count);
+
+	i_free(old_entries);
+}
 
-		for (node = node->next; node != NULL; node = next) {
-			next = node->next;
+static void hash_table_check_resize(struct hash_table *table)
+{
+	unsigned int wanted_size;
 
-			if (node->key != NULL) {
-				hash_table_insert_node(table, node->key,
-						       node->value, HASH_TABLE_OP_RESIZE);
-			}
-			free_node(table, node);
-		}
-	}
+	i_assert(table->frozen == 0);
 
-	table->frozen--;
+	if (table->overflow_nodes == NULL &&
+	    table->used_count < HASH_TABLE_MAX_LOAD(table->size) &&
+	    (table->nodes_count >= HASH_TABLE_MIN_LOAD(table->size) ||
+	     table->size == table->initial_size))
+		return;
 
-	i_free(old_nodes);
-	return TRUE;
+	/* grow, shrink or just get rid of the removed entries */
+	wanted_size = I_MAX(hash_table_get_wanted_size(table->nodes_count + 1),
+			    table->initial_size);
+	hash_table_resize(table, wanted_size);
 }
 
 void hash_table_copy(struct hash_table *dest, struct hash_table *src)
@@ -509,14 +541,10 @@ void hash_table_copy(struct hash_table *dest, struct hash_table *src)
 	struct hash_iterate_context *iter;
 	void *key, *value;
 
-	hash_table_freeze(dest);
-
 	iter = hash_table_iterate_init(src);
 	while (hash_table_iterate(iter, &key, &value))
 		hash_table_insert(dest, key, value);
 	hash_table_iterate_deinit(&iter);
-
-	hash_table_thaw(dest);
 }
 
 /* a char* hash function from ASU -- from glib */
@@ -557,21 +585,30 @@ strcase_hash(const char *p)
 	return h;
 }
 
+static inline uint64_t ATTR_NO_SANITIZE_INTEGER
+mem_hash_mix(uint64_t h)
+{
+	h *= 0x9e3779b97f4a7c15ULL;
+	return h ^ (h >> 29);
+}
+
+/* The hash isn't stored anywhere, so it can be changed freely. Handle the
+   data 8 bytes at a time, which is much faster than the per-byte hashes
+   above for anything larger than a few bytes (e.g. GUIDs). */
 unsigned int ATTR_NO_SANITIZE_INTEGER
 mem_hash(const void *p, unsigned int size)
 {
 	const unsigned char *s = p;
-	unsigned int i, g, h = 0;
-
-	for (i = 0; i < size; i++) {
-		h = (h << 4) + *s;
-		if ((g = h & 0xf0000000UL) != 0) {
-			h = h ^ (g >> 24);
-			h = h ^ g;
-		}
-		s++;
+	uint64_t h = size, last = 0;
+
+	for (; size >= 8; size -= 8, s += 8)
+		h = mem_hash_mix(h ^ le64_to_cpu_unaligned(s));
+	if (size > 0) {
+		for (; size > 0; size--, s++)
+			last = (last << 8) | *s;
+		h = mem_hash_mix(h ^ last);
 	}
-	return h;
+	return (unsigned int)(h ^ (h >> 32));
 }
 
 unsigned int ATTR_NO_SANITIZE_INTEGER
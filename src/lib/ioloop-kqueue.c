@@ -118,7 +118,7 @@ void io_loop_handle_remove(struct io_file *io, bool closed)
 
 	i_assert(io->refcount > 0);
 	if (--io->refcount == 0)
-		i_free(io);
+		p_free(ioloop_object_pool, io);
 }
 
 void io_loop_handler_run_internal(struct ioloop *ioloop)
@@ -183,7 +183,7 @@ void io_loop_handler_run_internal(struct ioloop *ioloop)
 
 		i_assert(io->refcount > 0);
 		if (--io->refcount == 0)
-			i_free(io);
+			p_free(ioloop_object_pool, io);
 	}
 }
 
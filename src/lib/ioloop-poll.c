@@ -118,7 +118,7 @@ void io_loop_handle_remove(struct io_file *io, bool closed ATTR_UNUSED)
 		}
 	}
 #endif
-	i_free(io);
+	p_free(ioloop_object_pool, io);
 
 	if ((condition & IO_READ) != 0) {
 		ctx->fds[index].events &= ENUM_NEGATE(POLLIN | POLLPRI);
@@ -9,6 +9,10 @@
 #  define IOLOOP_INITIAL_FD_COUNT 128
 #endif
 
+/* struct io_file and struct timeout are allocated from this slab pool, since
+   they're allocated and freed very often. It exists while any ioloop exists. */
+extern pool_t ioloop_object_pool;
+
 struct ioloop {
         struct ioloop *prev;
 
@@ -121,6 +125,17 @@ void io_loop_handle_remove(struct io_file *io, bool closed);
 void io_loop_handler_init(struct ioloop *ioloop, unsigned int initial_fd_count);
 void io_loop_handler_deinit(struct ioloop *ioloop);
 
+#ifdef IOLOOP_URING
+/* epoll handler calls, used by the io_uring handler when the kernel doesn't
+   support io_uring */
+void io_loop_epoll_handle_add(struct io_file *io);
+void io_loop_epoll_handle_remove(struct io_file *io, bool closed);
+void io_loop_epoll_handler_init(struct ioloop *ioloop,
+				unsigned int initial_fd_count);
+void io_loop_epoll_handler_deinit(struct ioloop *ioloop);
+void io_loop_epoll_handler_run_internal(struct ioloop *ioloop);
+#endif
+
 void io_loop_notify_remove(struct io *io);
 void io_loop_notify_handler_deinit(struct ioloop *ioloop);
 
@@ -0,0 +1,519 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "sleep.h"
+#include "ioloop-private.h"
+#include "ioloop-iolist.h"
+
+#ifdef IOLOOP_URING
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Number of submission queue entries. Poll requests for all the fds are
+   queued here and submitted in the same io_uring_enter() call that waits for
+   the completions, so this only needs to be large enough to avoid extra
+   submit-only syscalls when many fds change at once. */
+#define IOLOOP_URING_SQ_ENTRIES 256
+
+/* Completions of poll removal requests aren't interesting. Poll request
+   user_data is never 0. */
+#define IOLOOP_URING_USER_DATA_IGNORE 0
+
+/* Kernel features that we require. These are all available since Linux
+   v5.11. */
+#define IOLOOP_URING_REQUIRED_FEATURES \
+	(IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)
+
+#define IO_URING_ERROR (POLLERR | POLLHUP)
+#define IO_URING_INPUT (POLLIN | POLLPRI | IO_URING_ERROR)
+#define IO_URING_OUTPUT (POLLOUT | IO_URING_ERROR)
+
+enum uring_support {
+	URING_SUPPORT_UNKNOWN = 0,
+	URING_SUPPORT_YES,
+	/* kernel doesn't support io_uring - use epoll instead */
+	URING_SUPPORT_NO,
+};
+
+struct uring_fd {
+	struct io_list list;
+
+	/* user_data of the currently armed poll request, or 0 if none.
+	   Completions with any other user_data are stale and ignored. */
+	uint64_t user_data;
+	/* poll events of the currently armed request */
+	unsigned int events;
+};
+
+struct uring_ready {
+	struct uring_fd *ufd;
+	unsigned int revents;
+};
+
+struct ioloop_handler_context {
+	int ring_fd;
+
+	void *ring_ptr;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_khead, *sq_ktail, *sq_kring_mask;
+	unsigned int sq_entries, sq_tail;
+	unsigned int *cq_khead, *cq_ktail, *cq_kring_mask;
+	struct io_uring_cqe *cqes;
+
+	uint32_t next_seq;
+	ARRAY(struct uring_fd *) fd_index;
+	ARRAY(struct uring_ready) ready;
+};
+
+static enum uring_support uring_support = URING_SUPPORT_UNKNOWN;
+
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags, const void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, arg, argsz);
+}
+
+static int uring_init(struct ioloop_handler_context *ctx)
+{
+	struct io_uring_params params;
+	unsigned int i, *sq_array;
+	size_t sq_size, cq_size;
+
+	i_zero(&params);
+	ctx->ring_fd = sys_io_uring_setup(IOLOOP_URING_SQ_ENTRIES, &params);
+	if (ctx->ring_fd < 0)
+		return -1;
+	fd_close_on_exec(ctx->ring_fd, TRUE);
+
+	if ((params.features & IOLOOP_URING_REQUIRED_FEATURES) !=
+	    IOLOOP_URING_REQUIRED_FEATURES) {
+		i_close_fd(&ctx->ring_fd);
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	/* with IORING_FEAT_SINGLE_MMAP both rings are in the same mapping */
+	sq_size = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned int);
+	cq_size = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	ctx->ring_size = I_MAX(sq_size, cq_size);
+	ctx->ring_ptr = mmap(NULL, ctx->ring_size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ctx->ring_fd,
+			     IORING_OFF_SQ_RING);
+	if (ctx->ring_ptr == MAP_FAILED)
+		i_fatal("mmap(io_uring rings) failed: %m");
+	ctx->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sqes = mmap(NULL, ctx->sqes_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, ctx->ring_fd,
+			 IORING_OFF_SQES);
+	if (ctx->sqes == MAP_FAILED)
+		i_fatal("mmap(io_uring sqes) failed: %m");
+
+	ctx->sq_khead = PTR_OFFSET(ctx->ring_ptr, params.sq_off.head);
+	ctx->sq_ktail = PTR_OFFSET(ctx->ring_ptr, params.sq_off.tail);
+	ctx->sq_kring_mask = PTR_OFFSET(ctx->ring_ptr, params.sq_off.ring_mask);
+	ctx->sq_entries = params.sq_entries;
+	ctx->sq_tail = *ctx->sq_ktail;
+
+	/* SQEs are always used in ring order, so the indirection array is
+	   just an identity mapping */
+	sq_array = PTR_OFFSET(ctx->ring_ptr, params.sq_off.array);
+	for (i = 0; i < params.sq_entries; i++)
+		sq_array[i] = i;
+
+	ctx->cq_khead = PTR_OFFSET(ctx->ring_ptr, params.cq_off.head);
+	ctx->cq_ktail = PTR_OFFSET(ctx->ring_ptr, params.cq_off.tail);
+	ctx->cq_kring_mask = PTR_OFFSET(ctx->ring_ptr, params.cq_off.ring_mask);
+	ctx->cqes = PTR_OFFSET(ctx->ring_ptr, params.cq_off.cqes);
+	return 0;
+}
+
+static bool uring_errno_is_unsupported(int err)
+{
+	/* ENOSYS: kernel built without io_uring
+	   EPERM: disabled by kernel.io_uring_disabled sysctl or seccomp
+	   EINVAL, EOPNOTSUPP: too old kernel */
+	return err == ENOSYS || err == EPERM || err == EINVAL ||
+		err == EOPNOTSUPP;
+}
+
+static int
+uring_enter(struct ioloop_handler_context *ctx, bool wait, int msecs)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int to_submit;
+	int ret;
+
+	__atomic_store_n(ctx->sq_ktail, ctx->sq_tail, __ATOMIC_RELEASE);
+	to_submit = ctx->sq_tail - __atomic_load_n(ctx->sq_khead,
+						   __ATOMIC_ACQUIRE);
+	if (!wait) {
+		if (to_submit == 0)
+			return 0;
+		ret = sys_io_uring_enter(ctx->ring_fd, to_submit, 0, 0,
+					 NULL, 0);
+	} else {
+		i_zero(&arg);
+		if (msecs >= 0) {
+			i_zero(&ts);
+			ts.tv_sec = msecs / 1000;
+			ts.tv_nsec = (long long)(msecs % 1000) * 1000000;
+			arg.ts = (uintptr_t)&ts;
+		}
+		ret = sys_io_uring_enter(ctx->ring_fd, to_submit, 1,
+					 IORING_ENTER_GETEVENTS |
+					 IORING_ENTER_EXT_ARG,
+					 &arg, sizeof(arg));
+	}
+	if (ret < 0) {
+		/* ETIME: wait timed out
+		   EAGAIN, EBUSY: out of resources or the completion queue
+		   has overflown. The SQEs stay queued, so just handle the
+		   completions and try again later. */
+		if (errno != EINTR && errno != ETIME &&
+		    errno != EAGAIN && errno != EBUSY)
+			i_fatal("io_uring_enter() failed: %m");
+		return -1;
+	}
+	return ret;
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct ioloop_handler_context *ctx)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head;
+
+	head = __atomic_load_n(ctx->sq_khead, __ATOMIC_ACQUIRE);
+	if (ctx->sq_tail - head >= ctx->sq_entries) {
+		/* submission queue is full - submit it without waiting */
+		(void)uring_enter(ctx, FALSE, 0);
+		head = __atomic_load_n(ctx->sq_khead, __ATOMIC_ACQUIRE);
+		if (ctx->sq_tail - head >= ctx->sq_entries)
+			i_panic("io_uring submission queue stuck full");
+	}
+	sqe = &ctx->sqes[ctx->sq_tail & *ctx->sq_kring_mask];
+	ctx->sq_tail++;
+	i_zero(sqe);
+	return sqe;
+}
+
+static unsigned int uring_event_mask(struct io_list *list)
+{
+	unsigned int events = 0;
+	struct io_file *io;
+	int i;
+
+	for (i = 0; i < IOLOOP_IOLIST_IOS_PER_FD; i++) {
+		io = list->ios[i];
+
+		if (io == NULL)
+			continue;
+
+		if ((io->io.condition & IO_READ) != 0)
+			events |= IO_URING_INPUT;
+		if ((io->io.condition & IO_WRITE) != 0)
+			events |= IO_URING_OUTPUT;
+		if ((io->io.condition & IO_ERROR) != 0)
+			events |= IO_URING_ERROR;
+	}
+	return events;
+}
+
+static void
+uring_fd_arm(struct ioloop_handler_context *ctx, int fd, struct uring_fd *ufd)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int events;
+
+	i_assert(ufd->user_data == 0);
+
+	events = uring_event_mask(&ufd->list);
+	if (events == 0)
+		return;
+
+	/* The poll requests are one-shot, so they're re-armed after each
+	   completion. This keeps the level-triggered semantics that the
+	   I/O callbacks expect: if the callback didn't read everything,
+	   the re-armed poll completes immediately. */
+	if (++ctx->next_seq == 0)
+		ctx->next_seq++;
+	ufd->user_data = ((uint64_t)ctx->next_seq << 32) | (uint32_t)fd;
+	ufd->events = events;
+
+	sqe = uring_get_sqe(ctx);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+#ifdef WORDS_BIGENDIAN
+	sqe->poll32_events = (events << 16) | (events >> 16);
+#else
+	sqe->poll32_events = events;
+#endif
+	sqe->user_data = ufd->user_data;
+}
+
+static void
+uring_fd_disarm(struct ioloop_handler_context *ctx, struct uring_fd *ufd)
+{
+	struct io_uring_sqe *sqe;
+
+	if (ufd->user_data == 0)
+		return;
+
+	/* This must be done even if the fd was already closed, because the
+	   poll request keeps a reference to the file. */
+	sqe = uring_get_sqe(ctx);
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = ufd->user_data;
+	sqe->user_data = IOLOOP_URING_USER_DATA_IGNORE;
+
+	ufd->user_data = 0;
+	ufd->events = 0;
+}
+
+static void
+uring_fd_update(struct ioloop_handler_context *ctx, int fd,
+		struct uring_fd *ufd)
+{
+	if (ufd->user_data != 0 && ufd->events == uring_event_mask(&ufd->list))
+		return;
+	uring_fd_disarm(ctx, ufd);
+	uring_fd_arm(ctx, fd, ufd);
+}
+
+void io_loop_handler_init(struct ioloop *ioloop, unsigned int initial_fd_count)
+{
+	struct ioloop_handler_context *ctx;
+
+	if (uring_support == URING_SUPPORT_NO) {
+		io_loop_epoll_handler_init(ioloop, initial_fd_count);
+		return;
+	}
+
+	ctx = i_new(struct ioloop_handler_context, 1);
+	if (uring_init(ctx) < 0) {
+		if (uring_support == URING_SUPPORT_UNKNOWN &&
+		    uring_errno_is_unsupported(errno)) {
+			i_free(ctx);
+			uring_support = URING_SUPPORT_NO;
+			io_loop_epoll_handler_init(ioloop, initial_fd_count);
+			return;
+		}
+		if (errno != EMFILE && errno != ENOMEM)
+			i_fatal("io_uring_setup() failed: %m");
+		i_fatal("io_uring_setup() failed: %m (you may need to increase "
+			"the open files or locked memory limits)");
+	}
+	uring_support = URING_SUPPORT_YES;
+
+	i_array_init(&ctx->fd_index, initial_fd_count);
+	i_array_init(&ctx->ready, initial_fd_count);
+	ioloop->handler_context = ctx;
+}
+
+void io_loop_handler_deinit(struct ioloop *ioloop)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	struct uring_fd **ufds;
+	unsigned int i, count;
+
+	if (uring_support == URING_SUPPORT_NO) {
+		io_loop_epoll_handler_deinit(ioloop);
+		return;
+	}
+
+	ufds = array_get_modifiable(&ctx->fd_index, &count);
+	for (i = 0; i < count; i++)
+		i_free(ufds[i]);
+
+	if (munmap(ctx->sqes, ctx->sqes_size) < 0)
+		i_error("munmap(io_uring sqes) failed: %m");
+	if (munmap(ctx->ring_ptr, ctx->ring_size) < 0)
+		i_error("munmap(io_uring rings) failed: %m");
+	/* closing the ring cancels all the pending poll requests */
+	if (close(ctx->ring_fd) < 0)
+		i_error("close(io_uring) failed: %m");
+	array_free(&ctx->fd_index);
+	array_free(&ctx->ready);
+	i_free(ioloop->handler_context);
+}
+
+void io_loop_handle_add(struct io_file *io)
+{
+	struct ioloop_handler_context *ctx = io->io.ioloop->handler_context;
+	struct uring_fd **ufdp;
+
+	if (uring_support == URING_SUPPORT_NO) {
+		io_loop_epoll_handle_add(io);
+		return;
+	}
+
+	ufdp = array_idx_get_space(&ctx->fd_index, io->fd);
+	if (*ufdp == NULL)
+		*ufdp = i_new(struct uring_fd, 1);
+
+	(void)ioloop_iolist_add(&(*ufdp)->list, io);
+	/* The request is only queued here - it's submitted in the same
+	   syscall that waits for the next events. Outside io_loop_run()
+	   submit it immediately though, so fds that become ready before the
+	   ioloop starts running are reported in the order they became ready,
+	   like with epoll. */
+	uring_fd_update(ctx, io->fd, *ufdp);
+	if (!io->io.ioloop->iolooping)
+		(void)uring_enter(ctx, FALSE, 0);
+}
+
+void io_loop_handle_remove(struct io_file *io, bool closed)
+{
+	struct ioloop_handler_context *ctx = io->io.ioloop->handler_context;
+	struct uring_fd *ufd;
+
+	if (uring_support == URING_SUPPORT_NO) {
+		io_loop_epoll_handle_remove(io, closed);
+		return;
+	}
+
+	ufd = array_idx_elem(&ctx->fd_index, io->fd);
+	(void)ioloop_iolist_del(&ufd->list, io);
+
+	if (!closed)
+		uring_fd_update(ctx, io->fd, ufd);
+	else {
+		/* Don't poll the closed fd anymore, even if it still has
+		   other IOs. This is how epoll behaves as well. */
+		uring_fd_disarm(ctx, ufd);
+	}
+	p_free(ioloop_object_pool, io);
+}
+
+static void uring_handle_completions(struct ioloop_handler_context *ctx)
+{
+	const struct io_uring_cqe *cqe;
+	struct uring_fd *ufd;
+	struct uring_ready *ready;
+	unsigned int head, tail, fd;
+
+	array_clear(&ctx->ready);
+
+	head = *ctx->cq_khead;
+	tail = __atomic_load_n(ctx->cq_ktail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		cqe = &ctx->cqes[head & *ctx->cq_kring_mask];
+		if (cqe->user_data == IOLOOP_URING_USER_DATA_IGNORE)
+			continue;
+
+		fd = (uint32_t)cqe->user_data;
+		if (fd >= array_count(&ctx->fd_index))
+			continue;
+		ufd = array_idx_elem(&ctx->fd_index, fd);
+		if (ufd == NULL || ufd->user_data != cqe->user_data) {
+			/* IO was removed or modified after the request was
+			   submitted */
+			continue;
+		}
+		ufd->user_data = 0;
+		ufd->events = 0;
+
+		if (cqe->res == -EBADF) {
+			/* fd was closed without removing its IO */
+			continue;
+		}
+		ready = array_append_space(&ctx->ready);
+		ready->ufd = ufd;
+		ready->revents = cqe->res < 0 ? POLLERR : (unsigned int)cqe->res;
+
+		/* Re-arm immediately, so the fd keeps being polled even if
+		   the ioloop is stopped before its callbacks are called.
+		   Callbacks that remove or modify the IO replace this
+		   request. */
+		uring_fd_arm(ctx, fd, ufd);
+	}
+	__atomic_store_n(ctx->cq_khead, head, __ATOMIC_RELEASE);
+}
+
+void io_loop_handler_run_internal(struct ioloop *ioloop)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	const struct uring_ready *ready;
+	struct io_file *io;
+	struct timeval tv;
+	unsigned int i, j, count;
+	int msecs;
+	bool call;
+
+	if (uring_support == URING_SUPPORT_NO) {
+		io_loop_epoll_handler_run_internal(ioloop);
+		return;
+	}
+
+	i_assert(ctx != NULL);
+
+        /* get the time left for next timeout task */
+	msecs = io_loop_run_get_wait_time(ioloop, &tv);
+
+	if (ioloop->io_files != NULL) {
+		/* submit the queued poll requests and wait for completions */
+		(void)uring_enter(ctx, TRUE, msecs);
+	} else {
+		/* no I/Os, but we should have some timeouts.
+		   just wait for them. */
+		i_assert(msecs >= 0);
+		(void)uring_enter(ctx, FALSE, 0);
+		i_sleep_intr_msecs(msecs);
+	}
+
+	/* execute timeout handlers */
+        io_loop_handle_timeouts(ioloop);
+
+	if (!ioloop->running)
+		return;
+
+	uring_handle_completions(ctx);
+
+	count = array_count(&ctx->ready);
+	for (i = 0; i < count; i++) {
+		ready = array_idx(&ctx->ready, i);
+
+		for (j = 0; j < IOLOOP_IOLIST_IOS_PER_FD; j++) {
+			io = ready->ufd->list.ios[j];
+			if (io == NULL)
+				continue;
+
+			call = FALSE;
+			if ((ready->revents & (POLLHUP | POLLERR)) != 0)
+				call = TRUE;
+			else if ((io->io.condition & IO_READ) != 0)
+				call = (ready->revents & POLLIN) != 0;
+			else if ((io->io.condition & IO_WRITE) != 0)
+				call = (ready->revents & POLLOUT) != 0;
+			else if ((io->io.condition & IO_ERROR) != 0)
+				call = (ready->revents & IO_URING_ERROR) != 0;
+
+			if (call) {
+				io_loop_call_io(&io->io);
+				if (!ioloop->running)
+					return;
+			}
+		}
+	}
+}
+
+#endif	/* IOLOOP_URING */
@@ -9,6 +9,17 @@
 #include "ioloop-private.h"
 
 #include <unistd.h>
+#ifdef HAVE_VALGRIND_VALGRIND_H
+#  include <valgrind/valgrind.h>
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#  define IOLOOP_HAVE_ASAN
+#elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define IOLOOP_HAVE_ASAN
+#  endif
+#endif
 
 /* Dovecot attempts to detect also when time suddenly jumps forwards.
    This is done by getting the minimum timeout wait in epoll() (or similar)
@@ -28,10 +39,12 @@ time_t ioloop_time = 0;
 struct timeval ioloop_timeval;
 struct ioloop *current_ioloop = NULL;
 uint64_t ioloop_global_wait_usecs = 0;
+pool_t ioloop_object_pool = NULL;
 
 static ARRAY(io_switch_callback_t *) io_switch_callbacks = ARRAY_INIT;
 static ARRAY(io_destroy_callback_t *) io_destroy_callbacks = ARRAY_INIT;
 static bool panic_on_leak = FALSE, panic_on_leak_set = FALSE;
+static unsigned int ioloop_count = 0;
 
 static time_t data_stack_last_free_unused = 0;
 
@@ -56,7 +69,7 @@ io_add_file(struct ioloop *ioloop, int fd, enum io_condition condition,
 	i_assert(callback != NULL);
 	i_assert((condition & IO_NOTIFY) == 0);
 
-	io = i_new(struct io_file, 1);
+	io = p_new(ioloop_object_pool, struct io_file, 1);
         io->io.condition = condition;
 	io->io.callback = callback;
         io->io.context = context;
@@ -190,7 +203,7 @@ static void io_remove_full(struct io **_io, bool closed)
 		if (io_file->fd != -1)
 			io_loop_handle_remove(io_file, closed);
 		else
-			i_free(io);
+			p_free(ioloop_object_pool, io);
 
 		/* remove io from the ioloop before unreferencing the istream,
 		   because a destroyed istream may automatically close the
@@ -266,7 +279,7 @@ timeout_add_common(struct ioloop *ioloop, const char *source_filename,
 {
 	struct timeout *timeout;
 
-	timeout = i_new(struct timeout, 1);
+	timeout = p_new(ioloop_object_pool, struct timeout, 1);
 	timeout->item.idx = UINT_MAX;
 	timeout->source_filename = source_filename;
 	timeout->source_linenum = source_linenum;
@@ -396,7 +409,7 @@ static void timeout_free(struct timeout *timeout)
 {
 	if (timeout->ctx != NULL)
 		io_loop_context_unref(&timeout->ctx);
-	i_free(timeout);
+	p_free(ioloop_object_pool, timeout);
 }
 
 void timeout_remove(struct timeout **_timeout)
@@ -832,6 +845,21 @@ void io_loop_time_refresh(void)
 	ioloop_time = ioloop_timeval.tv_sec;
 }
 
+static pool_t ioloop_object_pool_create(void)
+{
+	/* The slab pool recycles the freed objects, which would hide
+	   use-after-free bugs from valgrind and ASan. */
+#ifdef IOLOOP_HAVE_ASAN
+	return system_pool;
+#else
+#  ifdef HAVE_VALGRIND_VALGRIND_H
+	if (RUNNING_ON_VALGRIND)
+		return system_pool;
+#  endif
+	return pool_slab_create("ioloop objects");
+#endif
+}
+
 struct ioloop *io_loop_create(void)
 {
 	struct ioloop *ioloop;
@@ -845,6 +873,9 @@ struct ioloop *io_loop_create(void)
 	i_gettimeofday(&ioloop_timeval);
 	ioloop_time = ioloop_timeval.tv_sec;
 
+	if (ioloop_count++ == 0)
+		ioloop_object_pool = ioloop_object_pool_create();
+
         ioloop = i_new(struct ioloop, 1);
 	ioloop->timeouts = priorityq_init(timeout_cmp, 32);
 	i_array_init(&ioloop->timeouts_new, 8);
@@ -956,6 +987,10 @@ void io_loop_destroy(struct ioloop **_ioloop)
 	if (ioloop->cur_ctx != NULL)
 		io_loop_context_unref(&ioloop->cur_ctx);
 	i_free(ioloop);
+
+	i_assert(ioloop_count > 0);
+	if (--ioloop_count == 0)
+		pool_unref(&ioloop_object_pool);
 }
 
 void io_loop_set_time_moved_callback(struct ioloop *ioloop,
@@ -0,0 +1,368 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+/* @UNSAFE: whole file */
+#include "lib.h"
+#include "mempool.h"
+#include "llist.h"
+
+/*
+ * Slab pools are meant for small objects that are allocated and freed often.
+ *
+ * Implementation
+ * ==============
+ *
+ * Small allocations are rounded up to a size class, which is a multiple of
+ * SLAB_CLASS_SIZE_STEP bytes. Objects of each size class are carved out of
+ * larger slabs (struct slab) that are malloc()ed from the system heap.
+ * Freed objects are put into the size class's free list, and the next
+ * allocation of the same size class takes an object from the free list. So
+ * once the pool has grown large enough, allocating and freeing doesn't call
+ * the system allocator at all.
+ *
+ * Allocations larger than the largest size class are calloc()ed separately
+ * (struct slab_large_block) and kept in a doubly-linked list.
+ *
+ * Each allocation is preceded by a header (struct slab_header) that contains
+ * the requested size, which is used to find the size class when freeing.
+ *
+ * The slabs are freed only when the pool is cleared or destroyed. Dovecot
+ * processes are single-threaded, so no locking is done.
+ *
+ * With DEBUG the objects in free lists are filled with CLEAR_CHR (except for
+ * the free list pointer), and allocating an object panics if it was modified
+ * after it was freed.
+ */
+
+#define SLAB_CLASS_SIZE_STEP 32
+#define SLAB_CLASS_COUNT 16
+#define SLAB_SIZE (1024*16)
+
+#ifdef DEBUG
+#  define CLEAR_CHR 0xde
+#endif
+
+struct slab {
+	struct slab *next;
+};
+
+struct slab_large_block {
+	struct slab_large_block *prev, *next;
+};
+
+struct slab_header {
+	size_t size;
+};
+
+struct slab_free_object {
+	struct slab_free_object *next;
+};
+
+struct slab_pool {
+	struct pool pool;
+	int refcount;
+
+	struct slab *slabs;
+	struct slab_large_block *large_blocks;
+	struct slab_free_object *free_objects[SLAB_CLASS_COUNT];
+
+	struct pool_slab_stats stats;
+#ifdef DEBUG
+	char *name;
+#endif
+};
+
+#define SIZEOF_SLAB_POOL MEM_ALIGN(sizeof(struct slab_pool))
+#define SIZEOF_SLAB MEM_ALIGN(sizeof(struct slab))
+#define SIZEOF_SLAB_LARGE_BLOCK MEM_ALIGN(sizeof(struct slab_large_block))
+#define SIZEOF_SLAB_HEADER MEM_ALIGN(sizeof(struct slab_header))
+
+#define SLAB_CLASS_OBJECT_SIZE(class_idx) \
+	(((class_idx) + 1) * SLAB_CLASS_SIZE_STEP)
+
+static const char *pool_slab_get_name(pool_t pool);
+static void pool_slab_ref(pool_t pool);
+static void pool_slab_unref(pool_t *pool);
+static void *pool_slab_malloc(pool_t pool, size_t size);
+static void pool_slab_free(pool_t pool, void *mem);
+static void *pool_slab_realloc(pool_t pool, void *mem,
+			       size_t old_size, size_t new_size);
+static void pool_slab_clear(pool_t pool);
+static size_t pool_slab_get_max_easy_alloc_size(pool_t pool);
+
+static const struct pool_vfuncs static_slab_pool_vfuncs = {
+	pool_slab_get_name,
+
+	pool_slab_ref,
+	pool_slab_unref,
+
+	pool_slab_malloc,
+	pool_slab_free,
+
+	pool_slab_realloc,
+
+	pool_slab_clear,
+	pool_slab_get_max_easy_alloc_size
+};
+
+static const struct pool static_slab_pool = {
+	.v = &static_slab_pool_vfuncs,
+
+	.alloconly_pool = FALSE,
+	.datastack_pool = FALSE
+};
+
+pool_t pool_slab_create(const char *name ATTR_UNUSED)
+{
+	struct slab_pool *spool;
+
+	(void)COMPILE_ERROR_IF_TRUE(SIZEOF_SLAB_HEADER >
+				    SLAB_CLASS_SIZE_STEP);
+	(void)COMPILE_ERROR_IF_TRUE(SLAB_CLASS_SIZE_STEP % MEM_ALIGN_SIZE != 0);
+
+	spool = calloc(1, SIZEOF_SLAB_POOL);
+	if (spool == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "calloc(1, %zu): Out of memory",
+			       SIZEOF_SLAB_POOL);
+#ifdef DEBUG
+	spool->name = strdup(name);
+#endif
+	spool->pool = static_slab_pool;
+	spool->refcount = 1;
+	return &spool->pool;
+}
+
+static void pool_slab_destroy(struct slab_pool *spool)
+{
+	pool_slab_clear(&spool->pool);
+#ifdef DEBUG
+	free(spool->name);
+#endif
+	free(spool);
+}
+
+static const char *pool_slab_get_name(pool_t pool ATTR_UNUSED)
+{
+#ifdef DEBUG
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	return spool->name;
+#else
+	return "slab";
+#endif
+}
+
+static void pool_slab_ref(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	i_assert(spool->refcount > 0);
+
+	spool->refcount++;
+}
+
+static void pool_slab_unref(pool_t *_pool)
+{
+	pool_t pool = *_pool;
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	i_assert(spool->refcount > 0);
+
+	/* erase the pointer before freeing anything, as the pointer may
+	   exist inside the pool's memory area */
+	*_pool = NULL;
+
+	if (--spool->refcount > 0)
+		return;
+
+	pool_slab_destroy(spool);
+}
+
+static inline unsigned int pool_slab_get_class(size_t size)
+{
+	/* returns >= SLAB_CLASS_COUNT for large allocations */
+	return (SIZEOF_SLAB_HEADER + size - 1) / SLAB_CLASS_SIZE_STEP;
+}
+
+#ifdef DEBUG
+static void
+pool_slab_object_poison(struct slab_free_object *object, size_t object_size)
+{
+	memset(PTR_OFFSET(object, sizeof(*object)), CLEAR_CHR,
+	       object_size - sizeof(*object));
+}
+
+static void
+pool_slab_object_check_poison(struct slab_pool *spool,
+			      struct slab_free_object *object,
+			      size_t object_size)
+{
+	const unsigned char *data = (const unsigned char *)object;
+
+	for (size_t i = sizeof(*object); i < object_size; i++) {
+		if (data[i] != CLEAR_CHR) {
+			i_panic("pool %s: Object %p was modified at offset %zu "
+				"after it was freed", spool->name, object, i);
+		}
+	}
+}
+#endif
+
+static void pool_slab_add_slab(struct slab_pool *spool, unsigned int class_idx)
+{
+	size_t object_size = SLAB_CLASS_OBJECT_SIZE(class_idx);
+	struct slab_free_object *object;
+	struct slab *slab;
+	size_t pos;
+
+	slab = malloc(SLAB_SIZE);
+	if (slab == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "malloc(%d): Out of memory",
+			       SLAB_SIZE);
+	slab->next = spool->slabs;
+	spool->slabs = slab;
+	spool->stats.alloc_size += SLAB_SIZE;
+
+	for (pos = SIZEOF_SLAB; pos + object_size <= SLAB_SIZE;
+	     pos += object_size) {
+		object = PTR_OFFSET(slab, pos);
+		object->next = spool->free_objects[class_idx];
+		spool->free_objects[class_idx] = object;
+#ifdef DEBUG
+		pool_slab_object_poison(object, object_size);
+#endif
+	}
+}
+
+static void *pool_slab_malloc(pool_t pool, size_t size)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	unsigned int class_idx = pool_slab_get_class(size);
+	struct slab_large_block *block;
+	struct slab_free_object *object;
+	struct slab_header *hdr;
+
+	if (class_idx >= SLAB_CLASS_COUNT) {
+		size_t alloc_size = SIZEOF_SLAB_LARGE_BLOCK +
+			SIZEOF_SLAB_HEADER + size;
+
+		block = calloc(1, alloc_size);
+		if (block == NULL)
+			i_fatal_status(FATAL_OUTOFMEM,
+				       "calloc(1, %zu): Out of memory",
+				       alloc_size);
+		DLLIST_PREPEND(&spool->large_blocks, block);
+		hdr = PTR_OFFSET(block, SIZEOF_SLAB_LARGE_BLOCK);
+		spool->stats.alloc_size += alloc_size;
+	} else {
+		if (spool->free_objects[class_idx] == NULL)
+			pool_slab_add_slab(spool, class_idx);
+		object = spool->free_objects[class_idx];
+#ifdef DEBUG
+		pool_slab_object_check_poison(spool, object,
+					      SLAB_CLASS_OBJECT_SIZE(class_idx));
+#endif
+		spool->free_objects[class_idx] = object->next;
+		memset(object, 0, SLAB_CLASS_OBJECT_SIZE(class_idx));
+		hdr = (struct slab_header *)object;
+	}
+	hdr->size = size;
+	spool->stats.alloc_count++;
+	spool->stats.used_size += size;
+	return PTR_OFFSET(hdr, SIZEOF_SLAB_HEADER);
+}
+
+static struct slab_header *pool_slab_get_header(void *mem)
+{
+	/* cannot use PTR_OFFSET because of negative value */
+	i_assert((uintptr_t)mem >= SIZEOF_SLAB_HEADER);
+	return (struct slab_header *)((unsigned char *)mem - SIZEOF_SLAB_HEADER);
+}
+
+static void pool_slab_free(pool_t pool, void *mem)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab_header *hdr = pool_slab_get_header(mem);
+	unsigned int class_idx = pool_slab_get_class(hdr->size);
+	struct slab_large_block *block;
+	struct slab_free_object *object;
+
+	i_assert(spool->stats.used_size >= hdr->size);
+	spool->stats.free_count++;
+	spool->stats.used_size -= hdr->size;
+
+	if (class_idx >= SLAB_CLASS_COUNT) {
+		block = (struct slab_large_block *)
+			((unsigned char *)hdr - SIZEOF_SLAB_LARGE_BLOCK);
+		i_assert((block->prev == NULL || block->prev->next == block) &&
+			 (block->next == NULL || block->next->prev == block));
+		DLLIST_REMOVE(&spool->large_blocks, block);
+		spool->stats.alloc_size -= SIZEOF_SLAB_LARGE_BLOCK +
+			SIZEOF_SLAB_HEADER + hdr->size;
+		free(block);
+	} else {
+		object = (struct slab_free_object *)hdr;
+		object->next = spool->free_objects[class_idx];
+		spool->free_objects[class_idx] = object;
+#ifdef DEBUG
+		pool_slab_object_poison(object,
+					SLAB_CLASS_OBJECT_SIZE(class_idx));
+#endif
+	}
+}
+
+static void *pool_slab_realloc(pool_t pool, void *mem,
+			       size_t old_size ATTR_UNUSED, size_t new_size)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab_header *hdr = pool_slab_get_header(mem);
+	unsigned int class_idx = pool_slab_get_class(hdr->size);
+	void *new_mem;
+
+	if (class_idx < SLAB_CLASS_COUNT &&
+	    class_idx == pool_slab_get_class(new_size)) {
+		/* still fits into the same object */
+		if (new_size > hdr->size) {
+			memset(PTR_OFFSET(mem, hdr->size), 0,
+			       new_size - hdr->size);
+		}
+		spool->stats.used_size += new_size;
+		spool->stats.used_size -= hdr->size;
+		hdr->size = new_size;
+		return mem;
+	}
+
+	new_mem = pool_slab_malloc(pool, new_size);
+	memcpy(new_mem, mem, I_MIN(hdr->size, new_size));
+	pool_slab_free(pool, mem);
+	return new_mem;
+}
+
+static void pool_slab_clear(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct slab_large_block *block;
+	struct slab *slab;
+
+	while (spool->large_blocks != NULL) {
+		block = spool->large_blocks;
+		DLLIST_REMOVE(&spool->large_blocks, block);
+		free(block);
+	}
+	while (spool->slabs != NULL) {
+		slab = spool->slabs;
+		spool->slabs = slab->next;
+		free(slab);
+	}
+	memset(spool->free_objects, 0, sizeof(spool->free_objects));
+	spool->stats.used_size = 0;
+	spool->stats.alloc_size = 0;
+}
+
+static size_t pool_slab_get_max_easy_alloc_size(pool_t pool ATTR_UNUSED)
+{
+	return 0;
+}
+
+void pool_slab_get_stats(pool_t pool, struct pool_slab_stats *stats_r)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+
+	*stats_r = spool->stats;
+}
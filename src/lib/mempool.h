@@ -87,6 +87,12 @@ pool_t pool_allocfree_create(const char *name);
    See pool_alloconly_create_clean. */
 pool_t pool_allocfree_create_clean(const char *name);
 
+/* Create a new slab pool. Small allocations are rounded up to a size class
+   and freed memory is reused for later allocations of the same size class,
+   so it's useful for objects that are allocated and freed often. Memory is
+   returned to the system only when the pool is cleared or freed. */
+pool_t pool_slab_create(const char *name);
+
 /* Similar to nearest_power(), but try not to exceed buffer's easy
    allocation size. If you don't have any explicit minimum size, use
    old_size + 1. */
@@ -189,6 +195,19 @@ size_t pool_allocfree_get_total_used_size(pool_t pool);
 /* Returns how much system memory has been allocated for this pool. */
 size_t pool_allocfree_get_total_alloc_size(pool_t pool);
 
+struct pool_slab_stats {
+	/* Number of allocations and frees done since the pool was created.
+	   A reallocation that needs to move the memory counts as both. */
+	uint64_t alloc_count, free_count;
+	/* Number of bytes currently allocated from the pool */
+	size_t used_size;
+	/* Number of bytes currently allocated from the system */
+	size_t alloc_size;
+};
+/* Returns the allocation statistics for a pool created with
+   pool_slab_create(). */
+void pool_slab_get_stats(pool_t pool, struct pool_slab_stats *stats_r);
+
 /* private: */
 void pool_system_free(pool_t pool, void *mem);
 void pool_external_refs_unref(pool_t pool);
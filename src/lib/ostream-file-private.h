@@ -19,6 +19,11 @@ struct file_ostream {
 	size_t buffer_size, optimal_block_size;
 	size_t head, tail; /* first unsent/unused byte */
 
+	/* pipe used by splice() for copying socket input to this stream.
+	   splice_pipe_used bytes are still waiting in it to be sent. */
+	int splice_fd[2];
+	size_t splice_pipe_used;
+
 	bool full:1; /* if head == tail, is buffer empty or full? */
 	bool file:1;
 	bool flush_pending:1;
@@ -28,6 +33,7 @@ struct file_ostream {
 	bool no_socket_quickack:1;
 	bool no_delay_enabled:1;
 	bool no_sendfile:1;
+	bool no_splice:1;
 	bool autoclose_fd:1;
 };
 
@@ -2,13 +2,19 @@
 
 /* @UNSAFE: whole file */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#define _GNU_SOURCE /* for splice() */
 #include "lib.h"
 #include "ioloop.h"
 #include "write-full.h"
+#include "fd-util.h"
 #include "net.h"
 #include "sendfile-util.h"
 #include "istream.h"
-#include "istream-private.h"
+#include "istream-file-private.h"
 #include "ostream-file-private.h"
 
 #include <unistd.h>
@@ -22,9 +28,15 @@
    128k as optimal size. */
 #define DEFAULT_OPTIMAL_BLOCK_SIZE IO_BLOCK_SIZE
 #define MAX_OPTIMAL_BLOCK_SIZE (128*1024)
+/* how much to splice() at a time. this is the default pipe capacity in
+   Linux, so a single splice() call doesn't block on a full pipe. */
+#define SPLICE_MAX_SIZE (64*1024)
 
 #define IS_STREAM_EMPTY(fstream) \
 	((fstream)->head == (fstream)->tail && !(fstream)->full)
+/* buffer is empty and there's nothing left in the splice() pipe */
+#define IS_STREAM_FLUSHED(fstream) \
+	(IS_STREAM_EMPTY(fstream) && (fstream)->splice_pipe_used == 0)
 
 #define MAX_SSIZE_T(size) \
 	((size) < SSIZE_T_MAX ? (size_t)(size) : SSIZE_T_MAX)
@@ -65,6 +77,10 @@ static void o_stream_file_destroy(struct iostream_private *stream)
 	struct file_ostream *fstream =
 		container_of(stream, struct file_ostream, ostream.iostream);
 
+	if (fstream->splice_fd[0] != -1) {
+		i_close_fd(&fstream->splice_fd[0]);
+		i_close_fd(&fstream->splice_fd[1]);
+	}
 	i_free(fstream->buffer);
 }
 
@@ -345,12 +361,51 @@ static int o_stream_fill_iovec(struct file_ostream *fstream,
 	}
 }
 
+#ifdef HAVE_SPLICE
+static int o_stream_file_splice_flush(struct file_ostream *fstream)
+{
+	unsigned int flags = SPLICE_F_MOVE;
+	ssize_t ret;
+
+	/* splice() may block on a full socket even with O_NONBLOCK */
+	if (!fstream->ostream.ostream.blocking)
+		flags |= SPLICE_F_NONBLOCK;
+
+	o_stream_socket_cork(fstream);
+	while (fstream->splice_pipe_used > 0) {
+		ret = splice(fstream->splice_fd[0], NULL, fstream->fd, NULL,
+			     fstream->splice_pipe_used, flags);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return 0;
+			io_stream_set_error(&fstream->ostream.iostream,
+					    "splice() failed: %m");
+			fstream->ostream.ostream.stream_errno = errno;
+			stream_closed(fstream);
+			return -1;
+		}
+		i_assert(ret > 0);
+		fstream->splice_pipe_used -= ret;
+		fstream->real_offset += ret;
+		fstream->buffer_offset += ret;
+	}
+	return 1;
+}
+#endif
+
 static int buffer_flush(struct file_ostream *fstream)
 {
 	struct const_iovec iov[2];
 	int iov_len;
 	ssize_t ret;
 
+#ifdef HAVE_SPLICE
+	/* the spliced data was sent before anything in the buffer */
+	if (fstream->splice_pipe_used > 0) {
+		if ((ret = o_stream_file_splice_flush(fstream)) <= 0)
+			return ret;
+	}
+#endif
 	iov_len = o_stream_fill_iovec(fstream, iov);
 	if (iov_len > 0) {
 		ret = o_stream_file_writev_full(fstream, iov, iov_len);
@@ -469,7 +524,8 @@ o_stream_file_get_buffer_used_size(const struct ostream_private *stream)
 	const struct file_ostream *fstream =
 		container_of(stream, const struct file_ostream, ostream);
 
-	return fstream->buffer_size - get_unused_space(fstream);
+	return fstream->buffer_size - get_unused_space(fstream) +
+		fstream->splice_pipe_used;
 }
 
 static int o_stream_file_seek(struct ostream_private *stream, uoff_t offset)
@@ -554,7 +610,7 @@ static void stream_send_io(struct file_ostream *fstream)
 	if (ret == 0)
 		fstream->flush_pending = TRUE;
 
-	if (!fstream->flush_pending && IS_STREAM_EMPTY(fstream)) {
+	if (!fstream->flush_pending && IS_STREAM_FLUSHED(fstream)) {
 		io_remove(&fstream->io);
 	} else if (!fstream->ostream.ostream.closed) {
 		/* Add the IO handler if it's not there already. Callback
@@ -626,14 +682,14 @@ ssize_t o_stream_file_sendv(struct ostream_private *stream,
 		size += iov[i].iov_len;
 	total_size = size;
 
-	if (size > get_unused_space(fstream) && !IS_STREAM_EMPTY(fstream)) {
+	if (size > get_unused_space(fstream) && !IS_STREAM_FLUSHED(fstream)) {
 		if (o_stream_file_flush(stream) < 0)
 			return -1;
 	}
 
 	optimal_size = I_MIN(fstream->optimal_block_size,
 			     fstream->ostream.max_buffer_size);
-	if (IS_STREAM_EMPTY(fstream) &&
+	if (IS_STREAM_FLUSHED(fstream) &&
 	    (!stream->corked || size >= optimal_size)) {
 		/* send immediately */
 		ret = o_stream_file_writev_full(fstream, iov, iov_count);
@@ -864,6 +920,97 @@ io_stream_sendfile(struct ostream_private *outstream,
 	return TRUE;
 }
 
+#ifdef HAVE_SPLICE
+static bool
+io_stream_can_splice(struct file_ostream *foutstream, struct istream *instream,
+		     int in_fd)
+{
+	struct istream_private *_instream = instream->real_stream;
+	struct file_istream *finstream;
+
+	/* splice() needs to read directly from the fd, so only a plain
+	   nonseekable fd istream without any buffered data will do. The
+	   output must also be written with the default writev(). */
+	if (foutstream->no_splice || in_fd == -1 || in_fd == foutstream->fd ||
+	    instream->seekable || _instream->parent != NULL ||
+	    _instream->read != i_stream_file_read ||
+	    foutstream->writev != o_stream_file_writev)
+		return FALSE;
+	finstream = container_of(_instream, struct file_istream, istream);
+	return !finstream->file && !finstream->seen_eof &&
+		finstream->skip_left == 0 &&
+		i_stream_get_data_size(instream) == 0;
+}
+
+static bool
+io_stream_splice(struct ostream_private *outstream,
+		 struct istream *instream, int in_fd,
+		 enum ostream_send_istream_result *res_r)
+{
+	struct file_ostream *foutstream =
+		container_of(outstream, struct file_ostream, ostream);
+	struct istream_private *_instream = instream->real_stream;
+	unsigned int flags = SPLICE_F_MOVE;
+	ssize_t ret;
+
+	if (!instream->blocking)
+		flags |= SPLICE_F_NONBLOCK;
+
+	if (foutstream->splice_fd[0] == -1) {
+		if (pipe(foutstream->splice_fd) < 0) {
+			i_error("pipe() failed: %m");
+			return FALSE;
+		}
+		fd_set_nonblock(foutstream->splice_fd[0], TRUE);
+		fd_set_nonblock(foutstream->splice_fd[1], TRUE);
+		fd_close_on_exec(foutstream->splice_fd[0], TRUE);
+		fd_close_on_exec(foutstream->splice_fd[1], TRUE);
+	}
+
+	for (;;) {
+		/* anything earlier must be sent before splicing more */
+		if ((ret = buffer_flush(foutstream)) < 0) {
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT;
+			return TRUE;
+		} else if (ret == 0) {
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT;
+			return TRUE;
+		}
+
+		ret = splice(in_fd, NULL, foutstream->splice_fd[1], NULL,
+			     SPLICE_MAX_SIZE, flags);
+		if (ret == 0) {
+			instream->eof = TRUE;
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_FINISHED;
+			return TRUE;
+		}
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN && !instream->blocking) {
+				*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT;
+				return TRUE;
+			}
+			if (errno == EINVAL || errno == ENOSYS) {
+				/* splice() not supported with this fd */
+				return FALSE;
+			}
+			io_stream_set_error(&_instream->iostream,
+					    "splice() failed: %m");
+			instream->stream_errno = errno;
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_INPUT;
+			return TRUE;
+		}
+		/* the istream is known to have nothing buffered, so the
+		   offset can be moved without seeking */
+		instream->v_offset += ret;
+		_instream->last_read_timeval = ioloop_timeval;
+		outstream->ostream.offset += ret;
+		foutstream->splice_pipe_used += ret;
+	}
+}
+#endif
+
 static enum ostream_send_istream_result
 io_stream_copy_backwards(struct ostream_private *outstream,
 			 struct istream *instream, uoff_t in_size)
@@ -1005,6 +1152,16 @@ o_stream_file_send_istream(struct ostream_private *outstream,
 		   regular sending. */
 		foutstream->no_sendfile = TRUE;
 	}
+#ifdef HAVE_SPLICE
+	if (io_stream_can_splice(foutstream, instream, in_fd)) {
+		if (io_stream_splice(outstream, instream, in_fd, &res))
+			return res;
+
+		/* splice() not supported (with this fd), fallback to
+		   regular sending. */
+		foutstream->no_splice = TRUE;
+	}
+#endif
 
 	same_stream = i_stream_get_fd(instream) == foutstream->fd &&
 		foutstream->fd != -1;
@@ -1030,6 +1187,7 @@ o_stream_create_file_common(struct file_ostream *fstream,
 	struct ostream *ostream;
 
 	fstream->fd = fd;
+	fstream->splice_fd[0] = fstream->splice_fd[1] = -1;
 	fstream->autoclose_fd = autoclose_fd;
 	fstream->optimal_block_size = DEFAULT_OPTIMAL_BLOCK_SIZE;
 
@@ -1063,6 +1221,7 @@ static void fstream_init_file(struct file_ostream *fstream)
 	struct stat st;
 
 	fstream->no_sendfile = TRUE;
+	fstream->no_splice = TRUE;
 	if (fstat(fstream->fd, &st) < 0)
 		return;
 
@@ -1104,6 +1263,7 @@ struct ostream * o_stream_create_fd_common(int fd, size_t max_buffer_size,
 		if (net_getsockname(fd, &local_ip, NULL) < 0) {
 			/* not a socket */
 			fstream->no_sendfile = TRUE;
+			fstream->no_splice = TRUE;
 			fstream->no_socket_cork = TRUE;
 			fstream->no_socket_nodelay = TRUE;
 			fstream->no_socket_quickack = TRUE;
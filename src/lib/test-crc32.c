@@ -3,7 +3,7 @@
 #include "test-lib.h"
 #include "crc32.h"
 
-void test_crc32(void)
+static void test_crc32_basic(void)
 {
 	const char str[] = "foo\0bar";
 
@@ -12,3 +12,36 @@ void test_crc32(void)
 	test_assert(crc32_data(str, sizeof(str)) == 0x32c9723d);
 	test_end();
 }
+
+static void test_crc32_long(void)
+{
+	const char str[] = "The quick brown fox jumps over the lazy dog";
+	unsigned char buf[1024];
+	uint32_t crc;
+
+	test_begin("crc32 long");
+	test_assert(crc32_data(str, strlen(str)) == 0x414fa339);
+	test_assert(crc32_data_more(crc32_data(str, 5), str + 5,
+				    strlen(str) - 5) == 0x414fa339);
+
+	/* compare against the byte-by-byte crc32_str() */
+	for (unsigned int i = 0; i < sizeof(buf); i++)
+		buf[i] = i_rand_minmax(1, 255);
+	for (unsigned int i = 0; i < 100; i++) {
+		size_t start = i_rand_limit(sizeof(buf) / 2);
+		size_t end = start + i_rand_limit(sizeof(buf) / 2);
+
+		T_BEGIN {
+			crc = crc32_data(buf + start, end - start);
+			test_assert_idx(crc == crc32_str(t_strndup(buf + start,
+							end - start)), i);
+		} T_END;
+	}
+	test_end();
+}
+
+void test_crc32(void)
+{
+	test_crc32_basic();
+	test_crc32_long();
+}
@@ -35,6 +35,59 @@ static void test_hash_random_pool(pool_t pool)
 	i_free(keys);
 }
 
+static void test_hash_iterate_modify(void)
+{
+	const unsigned int keymax = 1000;
+	HASH_TABLE(void *, void *) hash;
+	struct hash_iterate_context *iter;
+	void *key, *value;
+	unsigned int i, count = 0;
+
+	test_begin("hash table modify while iterating");
+	hash_table_create_direct(&hash, default_pool, 0);
+	for (i = 1; i <= keymax; i++)
+		hash_table_insert(hash, POINTER_CAST(i), POINTER_CAST(i));
+
+	/* remove the even keys and add two new keys for each key while
+	   iterating. the table can't be resized while it's frozen. */
+	iter = hash_table_iterate_init(hash);
+	while (hash_table_iterate(iter, hash, &key, &value)) {
+		test_assert(key == value);
+		i = POINTER_CAST_TO(key, unsigned int);
+		if (i > keymax) {
+			/* new key - may or may not be returned */
+			continue;
+		}
+		count++;
+		if (i % 2 == 0)
+			hash_table_remove(hash, key);
+		hash_table_insert(hash, POINTER_CAST(keymax + i * 2),
+				  POINTER_CAST(keymax + i * 2));
+		hash_table_insert(hash, POINTER_CAST(keymax + i * 2 + 1),
+				  POINTER_CAST(keymax + i * 2 + 1));
+	}
+	hash_table_iterate_deinit(&iter);
+	test_assert(count == keymax);
+
+	for (i = 1; i <= keymax; i++) {
+		test_assert_idx((hash_table_lookup(hash, POINTER_CAST(i)) != NULL) ==
+				(i % 2 != 0), i);
+	}
+	for (i = keymax + 2; i <= keymax * 3 + 1; i++)
+		test_assert_idx(hash_table_lookup(hash, POINTER_CAST(i)) != NULL, i);
+	test_assert(hash_table_count(hash) == keymax / 2 + keymax * 2);
+
+	/* all the nodes are returned once when nothing is modified */
+	count = 0;
+	iter = hash_table_iterate_init(hash);
+	while (hash_table_iterate(iter, hash, &key, &value))
+		count++;
+	hash_table_iterate_deinit(&iter);
+	test_assert(count == hash_table_count(hash));
+	hash_table_destroy(&hash);
+	test_end();
+}
+
 void test_hash(void)
 {
 	pool_t pool;
@@ -46,4 +99,6 @@ void test_hash(void)
 	test_hash_random_pool(pool);
 	pool_unref(&pool);
 	test_end();
+
+	test_hash_iterate_modify();
 }
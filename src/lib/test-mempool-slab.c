@@ -0,0 +1,111 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+
+static bool mem_has_bytes(const void *mem, size_t size, uint8_t b)
+{
+	const uint8_t *bytes = mem;
+	unsigned int i;
+
+	for (i = 0; i < size; i++) {
+		if (bytes[i] != b)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void test_mempool_slab_reuse(void)
+{
+	struct pool_slab_stats stats;
+	pool_t pool;
+	void *mem[100];
+	unsigned int i;
+
+	test_begin("mempool_slab reuse");
+	pool = pool_slab_create("test");
+	for (i = 0; i < N_ELEMENTS(mem); i++) {
+		mem[i] = p_malloc(pool, 40);
+		test_assert_idx(mem_has_bytes(mem[i], 40, 0), i);
+		memset(mem[i], 0xab, 40);
+	}
+	pool_slab_get_stats(pool, &stats);
+	test_assert(stats.alloc_count == N_ELEMENTS(mem));
+	test_assert(stats.used_size == N_ELEMENTS(mem) * 40);
+	size_t alloc_size = stats.alloc_size;
+
+	/* freed memory is reused and cleared */
+	for (i = 0; i < N_ELEMENTS(mem); i++)
+		p_free(pool, mem[i]);
+	for (i = 0; i < N_ELEMENTS(mem); i++) {
+		mem[i] = p_malloc(pool, 33 + i % 16);
+		test_assert_idx(mem_has_bytes(mem[i], 33 + i % 16, 0), i);
+	}
+	pool_slab_get_stats(pool, &stats);
+	test_assert(stats.alloc_size == alloc_size);
+	test_assert(stats.free_count == N_ELEMENTS(mem));
+
+	p_clear(pool);
+	pool_slab_get_stats(pool, &stats);
+	test_assert(stats.used_size == 0 && stats.alloc_size == 0);
+	pool_unref(&pool);
+	test_end();
+}
+
+static void test_mempool_slab_realloc(void)
+{
+	pool_t pool;
+	void *mem = NULL;
+	unsigned int i;
+
+	test_begin("mempool_slab realloc");
+	pool = pool_slab_create("test");
+	/* grows through all the size classes to large allocations */
+	for (i = 1; i < 2000; i++) {
+		mem = p_realloc(pool, mem, i-1, i);
+		test_assert_idx(mem_has_bytes(mem, i-1, 0xde), i);
+		test_assert_idx(mem_has_bytes(PTR_OFFSET(mem, i-1), 1, 0), i);
+		memset(mem, 0xde, i);
+	}
+	/* shrinking and growing back clears the memory */
+	mem = p_realloc(pool, mem, i-1, 10);
+	test_assert(mem_has_bytes(mem, 10, 0xde));
+	mem = p_realloc(pool, mem, 10, 20);
+	test_assert(mem_has_bytes(mem, 10, 0xde));
+	test_assert(mem_has_bytes(PTR_OFFSET(mem, 10), 10, 0));
+	p_free(pool, mem);
+	pool_unref(&pool);
+	test_end();
+}
+
+void test_mempool_slab(void)
+{
+	test_mempool_slab_reuse();
+	test_mempool_slab_realloc();
+}
+
+enum fatal_test_state fatal_mempool_slab(unsigned int stage)
+{
+#ifdef DEBUG
+	static pool_t pool;
+	unsigned char *mem, *freed_mem;
+
+	switch (stage) {
+	case 0: /* write after free */
+		test_begin("fatal_mempool_slab");
+		pool = pool_slab_create("fatal");
+		mem = p_malloc(pool, 40);
+		freed_mem = mem;
+		p_free(pool, mem);
+		freed_mem[39] = 1;
+		test_expect_fatal_string("was modified at offset");
+		(void)p_malloc(pool, 40);
+		return FATAL_TEST_FAILURE;
+	}
+
+	pool_unref(&pool);
+	test_end();
+	return FATAL_TEST_FINISHED;
+#else
+	return stage == 0 ? FATAL_TEST_FINISHED : FATAL_TEST_ABORT;
+#endif
+}
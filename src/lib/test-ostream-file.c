@@ -1,9 +1,12 @@
 /* Copyright (c) 2009-2018 Dovecot authors, see the included COPYING file */
 
 #include "test-lib.h"
+#include "ioloop.h"
 #include "net.h"
 #include "str.h"
+#include "buffer.h"
 #include "randgen.h"
+#include "write-full.h"
 #include "istream.h"
 #include "ostream.h"
 
@@ -176,6 +179,85 @@ static void test_ostream_file_send_istream_sendfile(void)
 	test_end();
 }
 
+static void test_ostream_file_read_available(int fd, buffer_t *buf)
+{
+	unsigned char data[1024];
+	ssize_t ret;
+
+	while ((ret = read(fd, data, sizeof(data))) > 0)
+		buffer_append(buf, data, ret);
+	test_assert(ret < 0 && errno == EAGAIN);
+}
+
+static void test_ostream_file_send_istream_splice(void)
+{
+	struct ioloop *ioloop;
+	struct istream *input;
+	struct ostream *output;
+	enum ostream_send_istream_result res;
+	buffer_t *sent, *received;
+	unsigned char data[1024*8];
+	int in_fd[2], out_fd[2], sndbuf = 4096;
+
+	test_begin("ostream file send istream splice()");
+	ioloop = io_loop_create();
+
+	i_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, in_fd) == 0);
+	i_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, out_fd) == 0);
+	net_set_nonblock(in_fd[0], TRUE);
+	net_set_nonblock(out_fd[0], TRUE);
+	net_set_nonblock(out_fd[1], TRUE);
+	/* make sure some of the data gets stuck waiting for output */
+	(void)setsockopt(out_fd[0], SOL_SOCKET, SO_SNDBUF,
+			 &sndbuf, sizeof(sndbuf));
+
+	input = i_stream_create_fd(in_fd[0], 1024);
+	output = o_stream_create_fd(out_fd[0], 0);
+	sent = buffer_create_dynamic(default_pool, 1024*128);
+	received = buffer_create_dynamic(default_pool, 1024*128);
+
+	test_assert(o_stream_send_istream(output, input) ==
+		    OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT);
+	for (unsigned int i = 0; i < 16; i++) {
+		random_fill(data, sizeof(data));
+		buffer_append(sent, data, sizeof(data));
+		if (write_full(in_fd[1], data, sizeof(data)) < 0)
+			i_fatal("write() failed: %m");
+		while ((res = o_stream_send_istream(output, input)) ==
+		       OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT)
+			test_ostream_file_read_available(out_fd[1], received);
+		test_assert(res == OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT);
+	}
+	i_close_fd(&in_fd[1]);
+	while ((res = o_stream_send_istream(output, input)) !=
+	       OSTREAM_SEND_ISTREAM_RESULT_FINISHED) {
+		test_assert(res == OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT);
+		test_ostream_file_read_available(out_fd[1], received);
+	}
+	test_assert(input->eof);
+	test_assert(input->v_offset == sent->used);
+	test_assert(output->offset == sent->used);
+
+	/* data sent afterwards must not get ahead of the spliced data */
+	o_stream_nsend_str(output, "trailer");
+	buffer_append(sent, "trailer", 7);
+	while (o_stream_flush(output) == 0)
+		test_ostream_file_read_available(out_fd[1], received);
+	test_ostream_file_read_available(out_fd[1], received);
+	test_assert(buffer_cmp(sent, received));
+
+	i_stream_destroy(&input);
+	test_assert(o_stream_finish(output) > 0);
+	o_stream_destroy(&output);
+	i_close_fd(&in_fd[0]);
+	i_close_fd(&out_fd[0]);
+	i_close_fd(&out_fd[1]);
+	buffer_free(&sent);
+	buffer_free(&received);
+	io_loop_destroy(&ioloop);
+	test_end();
+}
+
 static void test_ostream_file_send_over_iov_max(void)
 {
 	test_begin("ostream file send over IOV_MAX");
@@ -213,6 +295,7 @@ void test_ostream_file(void)
 	test_ostream_file_random();
 	test_ostream_file_send_istream_file();
 	test_ostream_file_send_istream_sendfile();
+	test_ostream_file_send_istream_splice();
 	test_ostream_file_send_over_iov_max();
 }
 
@@ -172,6 +172,21 @@ void test_unichar(void)
 	uni_utf8_to_decomposed_titlecase(collate_in, sizeof(collate_in),
 					 collate_out);
 	test_assert(strcmp(collate_out->data, collate_exp) == 0);
+
+	/* ASCII fast path must give the same output as the full lookups */
+	for (chr = 0; chr < 0x80; chr++) {
+		char input = chr;
+
+		buffer_set_used_size(collate_out, 0);
+		str_truncate(str, 0);
+		uni_utf8_to_decomposed_titlecase(&input, 1, collate_out);
+		uni_ucs4_to_utf8_c(uni_ucs4_to_titlecase(chr), str);
+		test_assert_idx(buffer_cmp(collate_out, str), chr);
+	}
+	buffer_set_used_size(collate_out, 0);
+	uni_utf8_to_decomposed_titlecase("ab\xc3\xbc\xff" "cd", 7, collate_out);
+	test_assert(collate_out->used == 10 &&
+		    memcmp(collate_out->data, "ABU\xcc\x88\xef\xbf\xbd" "CD", 10) == 0);
 	buffer_free(&collate_out);
 
 	test_assert(!uni_utf8_str_is_valid(overlong_utf8));
@@ -342,10 +342,26 @@ int uni_utf8_to_decomposed_titlecase(const void *_input, size_t size,
 				     buffer_t *output)
 {
 	const unsigned char *input = _input;
+	unsigned char *dest;
 	unichar_t chr;
+	size_t i, len;
 	int ret = 0;
 
 	while (size > 0) {
+		/* ASCII characters don't decompose and their titlecase is the
+		   same as uppercase, so handle them without the lookups */
+		for (len = 0; len < size && input[len] < 0x80; len++) ;
+		if (len > 0) {
+			dest = buffer_append_space_unsafe(output, len);
+			for (i = 0; i < len; i++) {
+				dest[i] = input[i] >= 'a' && input[i] <= 'z' ?
+					input[i] - 'a' + 'A' : input[i];
+			}
+			input += len;
+			size -= len;
+			continue;
+		}
+
 		int bytes = uni_utf8_get_char_n(input, size, &chr);
 		if (bytes <= 0) {
 			/* invalid input. try the next byte. */
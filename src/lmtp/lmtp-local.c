@@ -10,6 +10,7 @@
 #include "restrict-access.h"
 #include "anvil-client.h"
 #include "settings.h"
+#include "mail-index.h"
 #include "mail-storage.h"
 #include "mail-storage-service.h"
 #include "mail-namespace.h"
@@ -36,6 +37,9 @@ struct lmtp_local_recipient {
 	const struct lda_settings *lda_set;
 
 	bool anvil_connect_sent:1;
+	/* Mail was delivered, but replying is delayed until the index fsync
+	   group is committed. */
+	bool fsync_pending:1;
 };
 
 struct lmtp_local {
@@ -47,6 +51,8 @@ struct lmtp_local {
 	struct mail_user *rcpt_user;
 
 	struct smtp_server_stats stats;
+
+	bool fsync_group:1;
 };
 
 /*
@@ -538,8 +544,13 @@ lmtp_local_default_do_deliver(struct lmtp_local *local,
 			i_assert(local->first_saved_mail == NULL);
 			local->first_saved_mail = dctx->dest_mail;
 		}
-		smtp_server_recipient_reply(rcpt, 250, "2.0.0", "%s Saved",
-					    lldctx->session_id);
+		if (local->fsync_group)
+			llrcpt->fsync_pending = TRUE;
+		else {
+			smtp_server_recipient_reply(rcpt, 250, "2.0.0",
+						    "%s Saved",
+						    lldctx->session_id);
+		}
 		return 0;
 	}
 
@@ -639,6 +650,42 @@ int lmtp_local_default_deliver(struct client *client,
 	return ret;
 }
 
+static void
+lmtp_local_fsync_group_commit(struct lmtp_local *local,
+			      struct smtp_server_cmd_ctx *cmd)
+{
+	struct lmtp_local_recipient *llrcpt;
+	int ret;
+
+	i_assert(local->fsync_group);
+
+	local->fsync_group = FALSE;
+	ret = mail_index_fsync_group_commit();
+
+	/* duplicates always come after the recipient they duplicate, so its
+	   reply has been submitted by the time we get to them */
+	array_foreach_elem(&local->rcpt_to, llrcpt) {
+		struct smtp_server_recipient *rcpt = llrcpt->rcpt->rcpt;
+
+		if (!llrcpt->fsync_pending)
+			continue;
+		llrcpt->fsync_pending = FALSE;
+
+		if (llrcpt->duplicate != NULL) {
+			smtp_server_reply_submit_duplicate(
+				cmd, rcpt->index,
+				llrcpt->duplicate->rcpt->rcpt->index);
+		} else if (ret < 0) {
+			smtp_server_recipient_reply(rcpt, 451, "4.3.0",
+						    "Temporary internal error");
+		} else {
+			smtp_server_recipient_reply(rcpt, 250, "2.0.0",
+						    "%s Saved",
+						    llrcpt->rcpt->session_id);
+		}
+	}
+}
+
 static uid_t
 lmtp_local_deliver_to_rcpts(struct lmtp_local *local,
 			    struct smtp_server_cmd_ctx *cmd,
@@ -652,6 +699,12 @@ lmtp_local_deliver_to_rcpts(struct lmtp_local *local,
 	unsigned int count, i;
 	int ret;
 
+	/* Don't wait for the disk separately for each recipient. The
+	   successful recipients are replied to only after all of their
+	   transaction logs have been fdatasync()ed. */
+	mail_index_fsync_group_begin();
+	local->fsync_group = TRUE;
+
 	src_mail = local->raw_mail;
 	llrcpts = array_get(&local->rcpt_to, &count);
 	for (i = 0; i < count; i++) {
@@ -662,6 +715,10 @@ lmtp_local_deliver_to_rcpts(struct lmtp_local *local,
 			struct smtp_server_recipient *drcpt =
 				llrcpt->duplicate->rcpt->rcpt;
 			/* don't deliver more than once to the same recipient */
+			if (llrcpt->duplicate->fsync_pending) {
+				llrcpt->fsync_pending = TRUE;
+				continue;
+			}
 			smtp_server_reply_submit_duplicate(cmd, rcpt->index,
 							   drcpt->index);
 			continue;
@@ -697,6 +754,7 @@ lmtp_local_deliver_to_rcpts(struct lmtp_local *local,
 			mail_storage_service_io_deactivate_user(local->rcpt_user->service_user);
 		}
 	}
+	lmtp_local_fsync_group_commit(local, cmd);
 	return first_uid;
 }
 
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "buffer.h"
 #include "istream.h"
 #include "istream-seekable.h"
 #include "ostream.h"
@@ -10,6 +11,7 @@
 #include "mail-user.h"
 #include "index-storage.h"
 #include "index-mail.h"
+#include "mail-cache.h"
 #include "compression.h"
 #include "mail-compress-plugin.h"
 
@@ -25,6 +27,12 @@
 #define MAX_INBUF_SIZE (1024*1024)
 #define MAIL_COMPRESS_MAIL_CACHE_EXPIRE_MSECS (60*1000)
 
+struct mail_compress_mailbox {
+	union mailbox_module_context module_ctx;
+	/* box->cache has a compression registration for this mailbox */
+	bool cache_compression_registered;
+};
+
 struct mail_compress_mail {
 	union mail_module_context module_ctx;
 	bool verifying_save;
@@ -40,10 +48,12 @@ struct mail_compress_mail_cache {
 
 struct mail_compress_user {
 	union mail_user_module_context module_ctx;
+	struct event *event;
 
 	struct mail_compress_mail_cache cache;
 
 	const struct compression_handler *save_handler;
+	unsigned int cache_min_size;
 };
 
 #undef DEF
@@ -52,12 +62,14 @@ struct mail_compress_user {
 
 static struct setting_define mail_compress_setting_defines[] = {
 	DEF(STR, mail_compress_write_method),
+	DEF(SIZE, mail_compress_cache_min_size),
 
 	SETTING_DEFINE_LIST_END
 };
 
 static struct mail_compress_settings mail_compress_default_settings = {
 	.mail_compress_write_method = "",
+	.mail_compress_cache_min_size = 0,
 };
 
 const struct setting_parser_info mail_compress_setting_parser_info = {
@@ -223,13 +235,13 @@ static void mail_compress_mail_allocated(struct mail *_mail)
 static int mail_compress_mail_save_finish(struct mail_save_context *ctx)
 {
 	struct mailbox *box = ctx->transaction->box;
-	union mailbox_module_context *zbox = MAIL_COMPRESS_CONTEXT(box);
+	struct mail_compress_mailbox *zbox = MAIL_COMPRESS_CONTEXT(box);
 	struct mail_private *mail = (struct mail_private *)ctx->dest_mail;
 	struct mail_compress_mail *zmail = MAIL_COMPRESS_MAIL_CONTEXT(mail);
 	struct istream *input;
 	int ret;
 
-	if (zbox->super.save_finish(ctx) < 0)
+	if (zbox->module_ctx.super.save_finish(ctx) < 0)
 		return -1;
 
 	zmail->verifying_save = TRUE;
@@ -252,10 +264,10 @@ mail_compress_mail_save_compress_begin(struct mail_save_context *ctx,
 {
 	struct mailbox *box = ctx->transaction->box;
 	struct mail_compress_user *zuser = MAIL_COMPRESS_USER_CONTEXT(box->storage->user);
-	union mailbox_module_context *zbox = MAIL_COMPRESS_CONTEXT(box);
+	struct mail_compress_mailbox *zbox = MAIL_COMPRESS_CONTEXT(box);
 	struct ostream *output;
 
-	if (zbox->super.save_begin(ctx, input) < 0)
+	if (zbox->module_ctx.super.save_begin(ctx, input) < 0)
 		return -1;
 
 	output = zuser->save_handler->create_ostream_auto(ctx->data.output,
@@ -311,40 +323,128 @@ static void mail_compress_mailbox_open_input(struct mailbox *box)
 	}
 }
 
+static int
+mail_compress_cache_compress(void *context, const void *data, size_t size,
+			     buffer_t *dest, const char **error_r)
+{
+	struct mail_compress_user *zuser = context;
+	struct ostream *output, *zoutput;
+	int ret;
+
+	output = o_stream_create_buffer(dest);
+	zoutput = zuser->save_handler->create_ostream_auto(output,
+							   zuser->event);
+	o_stream_unref(&output);
+	o_stream_nsend(zoutput, data, size);
+	if ((ret = o_stream_finish(zoutput)) < 0)
+		*error_r = t_strdup(o_stream_get_error(zoutput));
+	o_stream_destroy(&zoutput);
+	return ret < 0 ? -1 : 0;
+}
+
+static int
+mail_compress_cache_decompress(void *context ATTR_UNUSED,
+			       const void *data, size_t size,
+			       buffer_t *dest, const char **error_r)
+{
+	struct istream *input, *zinput;
+	const unsigned char *zdata;
+	size_t zsize;
+	int ret;
+
+	input = i_stream_create_from_data(data, size);
+	zinput = i_stream_create_decompress(input, 0);
+	i_stream_unref(&input);
+	while ((ret = i_stream_read_more(zinput, &zdata, &zsize)) > 0) {
+		buffer_append(dest, zdata, zsize);
+		i_stream_skip(zinput, zsize);
+	}
+	i_assert(ret == -1);
+	if (zinput->stream_errno != 0) {
+		*error_r = t_strdup(i_stream_get_error(zinput));
+		ret = -1;
+	} else {
+		ret = 0;
+	}
+	i_stream_destroy(&zinput);
+	return ret;
+}
+
+static const struct mail_cache_compression mail_compress_cache_compression = {
+	.compress = mail_compress_cache_compress,
+	.decompress = mail_compress_cache_decompress,
+};
+
+static const struct mail_cache_compression mail_compress_cache_decompression = {
+	.decompress = mail_compress_cache_decompress,
+};
+
+static void mail_compress_mailbox_set_cache(struct mailbox *box)
+{
+	struct mail_compress_mailbox *zbox = MAIL_COMPRESS_CONTEXT(box);
+	struct mail_compress_user *zuser =
+		MAIL_COMPRESS_USER_CONTEXT(box->storage->user);
+
+	/* Compressed fields can always be read, but new fields are compressed
+	   only when it's enabled. The decompression relies on detecting the
+	   format, so it's not possible with e.g. deflate. */
+	if (zuser->save_handler == NULL || zuser->cache_min_size == 0 ||
+	    zuser->save_handler->is_compressed == NULL) {
+		mail_cache_register_compression(box->cache,
+			&mail_compress_cache_decompression, zuser, 0);
+	} else {
+		mail_cache_register_compression(box->cache,
+			&mail_compress_cache_compression, zuser,
+			zuser->cache_min_size);
+	}
+	zbox->cache_compression_registered = TRUE;
+}
+
 static int mail_compress_mailbox_open(struct mailbox *box)
 {
-	union mailbox_module_context *zbox = MAIL_COMPRESS_CONTEXT(box);
+	struct mail_compress_mailbox *zbox = MAIL_COMPRESS_CONTEXT(box);
 
 	if (box->input == NULL &&
 	    (box->storage->class_flags &
 	     MAIL_STORAGE_CLASS_FLAG_OPEN_STREAMS) != 0)
 		mail_compress_mailbox_open_input(box);
 
-	return zbox->super.open(box);
+	if (zbox->module_ctx.super.open(box) < 0)
+		return -1;
+	if (box->cache != NULL)
+		mail_compress_mailbox_set_cache(box);
+	return 0;
 }
 
 static void mail_compress_mailbox_close(struct mailbox *box)
 {
-	union mailbox_module_context *zbox = MAIL_COMPRESS_CONTEXT(box);
+	struct mail_compress_mailbox *zbox = MAIL_COMPRESS_CONTEXT(box);
 	struct mail_compress_user *zuser = MAIL_COMPRESS_USER_CONTEXT(box->storage->user);
 
 	if (zuser->cache.box == box)
 		mail_compress_mail_cache_close(zuser);
-	zbox->super.close(box);
+	/* The cache is shared with the mailbox's other instances, and it may
+	   stay open in the index cache after the user is already freed. Remove
+	   only this instance's registration. */
+	if (zbox->cache_compression_registered) {
+		mail_cache_unregister_compression(box->cache, zuser);
+		zbox->cache_compression_registered = FALSE;
+	}
+	zbox->module_ctx.super.close(box);
 }
 
 static void mail_compress_mailbox_allocated(struct mailbox *box)
 {
 	struct mailbox_vfuncs *v = box->vlast;
-	union mailbox_module_context *zbox;
+	struct mail_compress_mailbox *zbox;
 
-	zbox = p_new(box->pool, union mailbox_module_context, 1);
-	zbox->super = *v;
-	box->vlast = &zbox->super;
+	zbox = p_new(box->pool, struct mail_compress_mailbox, 1);
+	zbox->module_ctx.super = *v;
+	box->vlast = &zbox->module_ctx.super;
 	v->open = mail_compress_mailbox_open;
 	v->close = mail_compress_mailbox_close;
 
-	MODULE_CONTEXT_SET_SELF(box, mail_compress_storage_module, zbox);
+	MODULE_CONTEXT_SET(box, mail_compress_storage_module, zbox);
 
 	if (mail_compress_mailbox_is_permail(box))
 		mail_compress_permail_alloc_init(box, v);
@@ -370,6 +470,7 @@ static void mail_compress_mail_user_created(struct mail_user *user)
 	zuser->module_ctx.super = *v;
 	user->vlast = &zuser->module_ctx.super;
 	v->deinit = mail_compress_mail_user_deinit;
+	zuser->event = user->event;
 
 	if (settings_get(user->event, &mail_compress_setting_parser_info, 0,
 			 &set, &error) < 0) {
@@ -389,6 +490,8 @@ static void mail_compress_mail_user_created(struct mail_user *user)
 			return;
 		}
 	}
+	zuser->cache_min_size = I_MIN(set->mail_compress_cache_min_size,
+				      UINT_MAX);
 	settings_free(set);
 
 	MODULE_CONTEXT_SET(user, mail_compress_user_module, zuser);
@@ -4,6 +4,7 @@
 struct mail_compress_settings {
 	pool_t pool;
 	const char *mail_compress_write_method;
+	uoff_t mail_compress_cache_min_size;
 };
 
 extern const struct setting_parser_info mail_compress_setting_parser_info;
@@ -903,8 +903,8 @@ static int virtual_sync_backend_box_continue(struct virtual_sync_context *ctx,
 	struct mail_search_result *result;
 	ARRAY_TYPE(seq_range) expunged_uids = ARRAY_INIT, removed_uids;
 	ARRAY_TYPE(seq_range) added_uids, flag_update_uids;
-	uint64_t modseq, old_highest_modseq;
-	uint32_t seq, uid, old_msg_count;
+	uint64_t modseqs[256], old_highest_modseq;
+	uint32_t seq, uid, old_msg_count, i, count;
 
 	/* initialize the search result from all the existing messages in
 	   virtual index. */
@@ -936,10 +936,15 @@ static int virtual_sync_backend_box_continue(struct virtual_sync_context *ctx,
 
 	t_array_init(&flag_update_uids, I_MIN(128, old_msg_count));
 	if (bbox->sync_highest_modseq < old_highest_modseq) {
-		for (seq = 1; seq <= old_msg_count; seq++) {
-			modseq = mail_index_modseq_lookup(view, seq);
-			if (modseq > bbox->sync_highest_modseq) {
-				mail_index_lookup_uid(view, seq, &uid);
+		for (seq = 1; seq <= old_msg_count; seq += count) {
+			count = I_MIN(N_ELEMENTS(modseqs),
+				      old_msg_count - seq + 1);
+			mail_index_modseq_lookup_range(view, seq,
+						       seq + count - 1, modseqs);
+			for (i = 0; i < count; i++) {
+				if (modseqs[i] <= bbox->sync_highest_modseq)
+					continue;
+				mail_index_lookup_uid(view, seq + i, &uid);
 				seq_range_array_add(&flag_update_uids, uid);
 			}
 		}